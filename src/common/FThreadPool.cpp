@@ -0,0 +1,114 @@
+﻿//////////////////////////////////////////////////////////////////////
+/// Desc  FThreadPool
+/// Time  2026/10/18
+/// Author youlanhai
+//////////////////////////////////////////////////////////////////////
+#include "FThreadPool.hpp"
+
+NS_FXP_BEGIN
+
+FThreadPool::FThreadPool(int threadCount)
+    : next_(0)
+{
+    for (int i = 1; i < threadCount; ++i)
+    {
+        workers_.push_back(std::thread(&FThreadPool::workerMain, this));
+    }
+}
+
+FThreadPool::~FThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    startCond_.notify_all();
+
+    for (std::thread &t : workers_)
+    {
+        t.join();
+    }
+}
+
+void FThreadPool::parallelFor(size_t count, size_t batch, const Task &task)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    if (batch == 0)
+    {
+        batch = 1;
+    }
+
+    // 任务量太少，不值得唤醒工作线程
+    if (workers_.empty() || count <= batch)
+    {
+        task(0, count);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        task_ = &task;
+        count_ = count;
+        batch_ = batch;
+        next_.store(0);
+        pending_ = (int)workers_.size();
+        ++generation_;
+    }
+    startCond_.notify_all();
+
+    runBatches();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    doneCond_.wait(lock, [this]{ return pending_ == 0; });
+    task_ = nullptr;
+}
+
+void FThreadPool::workerMain()
+{
+    uint64_t generation = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            startCond_.wait(lock, [&]{ return stop_ || generation_ != generation; });
+            if (stop_)
+            {
+                return;
+            }
+            generation = generation_;
+        }
+
+        runBatches();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --pending_;
+        }
+        doneCond_.notify_one();
+    }
+}
+
+void FThreadPool::runBatches()
+{
+    while (true)
+    {
+        size_t begin = next_.fetch_add(batch_);
+        if (begin >= count_)
+        {
+            break;
+        }
+
+        size_t end = begin + batch_;
+        if (end > count_)
+        {
+            end = count_;
+        }
+        (*task_)(begin, end);
+    }
+}
+
+NS_FXP_END
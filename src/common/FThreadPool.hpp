@@ -0,0 +1,62 @@
+﻿//////////////////////////////////////////////////////////////////////
+/// Desc  FThreadPool
+/// Time  2026/10/18
+/// Author youlanhai
+//////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "FConfig.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+NS_FXP_BEGIN
+
+/** 简单的线程池，只支持阻塞式的parallelFor。调用线程也会参与计算。*/
+class FXP_API FThreadPool
+{
+    DISABLE_COPY_AND_ASSIGN(FThreadPool);
+public:
+    /** 处理区间[begin, end)的任务 */
+    typedef std::function<void(size_t begin, size_t end)> Task;
+
+    /** @param threadCount 总线程数，包括调用线程 */
+    explicit FThreadPool(int threadCount);
+    ~FThreadPool();
+
+    int getThreadCount() const { return (int)workers_.size() + 1; }
+
+    /** 把[0, count)拆分成大小为batch的若干段并行执行，所有段执行完毕后返回。
+     *  段的执行顺序和执行线程是不确定的，task需要保证各段之间没有数据竞争。
+     */
+    void parallelFor(size_t count, size_t batch, const Task &task);
+
+private:
+    void workerMain();
+
+    /** 领取并执行任务段，直到没有剩余的任务 */
+    void runBatches();
+
+    std::vector<std::thread>    workers_;
+    std::mutex                  mutex_;
+    std::condition_variable     startCond_;
+    std::condition_variable     doneCond_;
+
+    const Task*                 task_ = nullptr;
+    size_t                      count_ = 0;
+    size_t                      batch_ = 1;
+    std::atomic<size_t>         next_;
+
+    /** 还没有完成当前任务的工作线程数量 */
+    int                         pending_ = 0;
+    /** 任务的批次。工作线程通过它判断是否有新任务 */
+    uint64_t                    generation_ = 0;
+    bool                        stop_ = false;
+};
+
+NS_FXP_END
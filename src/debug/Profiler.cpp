@@ -9,6 +9,7 @@
 #include "LogTool.hpp"
 
 #include <stack>
+#include <thread>
 #include <vector>
 #include <sstream>
 #include <algorithm>
@@ -25,11 +26,14 @@ class ProfilerImp
 public:
     std::stack<ProfilerNode*> stack;
     // std::mutex lock;
+    /** 只统计创建Profiler的线程。多线程查询时，其它线程的调用直接忽略 */
+    std::thread::id threadID = std::this_thread::get_id();
 };
 
 Profiler::Profiler()
     : enabled_(true)
     , comma_(true)
+    , pauseCount_(0)
 {
     root_ = new ProfilerNode(PK_ROOT);
     imp_ = new ProfilerImp();
@@ -42,7 +46,7 @@ Profiler::~Profiler()
 
 void Profiler::begin(int key)
 {
-    if (!enabled_)
+    if (!enabled_ || pauseCount_ > 0 || std::this_thread::get_id() != imp_->threadID)
     {
         return;
     }
@@ -65,7 +69,7 @@ void Profiler::begin(int key)
 
 void Profiler::end(int key)
 {
-    if (!enabled_)
+    if (!enabled_ || pauseCount_ > 0 || std::this_thread::get_id() != imp_->threadID)
     {
         return;
     }
@@ -40,6 +40,11 @@ public:
     void setEnable(bool enable);
     bool isEnabled() const { return enabled_; }
 
+    /** 暂停统计，可以嵌套调用。与setEnable(false)不同，不会结束已经开始的结点，resume之后继续统计 */
+    void pause() { ++pauseCount_; }
+    void resume() { --pauseCount_; }
+    bool isPaused() const { return pauseCount_ > 0; }
+
     void setCommaEnable(bool enable) { comma_ = enable; }
 
     static Profiler* getDefault();
@@ -49,6 +54,7 @@ private:
     ProfilerImp*    imp_;
     bool            enabled_;
     bool            comma_;
+    int             pauseCount_;
 };
 
 class FXP_API ProfilerScop
@@ -28,6 +28,14 @@ public:
         R(PK_PHYSICS_BVH_REBUILD, "bvhRebuild");
         R(PK_PHYSICS_COLLIDERCAST, "colliderCast");
         R(PK_PHYSICS_NOTIFY, "notify");
+        R(PK_PHYSICS_ISLAND, "island");
+        R(PK_PHYSICS_CCD, "ccd");
+        R(PK_PHYSICS_PROJECTILE, "projectile");
+        R(PK_PHYSICS_INTEREST, "interest");
+        R(PK_PHYSICS_SNAPSHOT, "snapshot");
+        R(PK_PHYSICS_SAVE_STATE, "save state");
+        R(PK_PHYSICS_RESTORE_STATE, "restore state");
+        R(PK_PHYSICS_RESIMULATE, "resimulate");
 
         R(PK_TIMER, "timer");
         R(PK_TIMER_CALL, "timerCall");
@@ -31,6 +31,14 @@ enum ProfilerKey
     PK_PHYSICS_BVH_REBUILD = 18,
     PK_PHYSICS_COLLIDERCAST = 19,
     PK_PHYSICS_NOTIFY = 20,
+    PK_PHYSICS_ISLAND = 21,
+    PK_PHYSICS_CCD = 22,
+    PK_PHYSICS_PROJECTILE = 23,
+    PK_PHYSICS_INTEREST = 24,
+    PK_PHYSICS_SNAPSHOT = 25,
+    PK_PHYSICS_SAVE_STATE = 26,
+    PK_PHYSICS_RESTORE_STATE = 27,
+    PK_PHYSICS_RESIMULATE = 28,
 
     PK_TIMER = 50,
     PK_TIMER_CALL = 51,
@@ -0,0 +1,226 @@
+﻿//////////////////////////////////////////////////////////////////////
+/// Desc  TestFPhysics
+/// Time  2026/10/18
+/// Author youlanhai
+//////////////////////////////////////////////////////////////////////
+
+#include "physics2d/FPhysicsAPI.hpp"
+#include "physics2d/FContactSolver.hpp"
+#include "common/SmartPtr.hpp"
+#include "LogTool.hpp"
+#include "TestTool.hpp"
+
+#include <vector>
+
+NS_FXP_BEGIN
+
+static const FFloat TEST_DELTA_TIME = FFloat(1) / 30;
+
+/** 地面上的几堆箱子和圆，有堆叠、休眠和连续碰撞检测，覆盖求解器的大部分路径 */
+static void buildTestScene(FPhysics2D *physics, std::vector<FRigidbodyPtr> &bodies)
+{
+    physics->setGravity(FVector3(0, 0, -10));
+
+    FRigidbody *ground = physics->getStaticRigidbody();
+    ground->addCollider(new FPolygonCollider(FBB(FVector2(-100, -2), FVector2(100, 0))));
+
+    for (int c = 0; c < 8; ++c)
+    {
+        for (int i = 0; i < 6; ++i)
+        {
+            FRigidbody *body = FRigidbody::New(FFloat(1), FFloat(1));
+            if (i % 3 == 0)
+            {
+                body->addCollider(new FCircleCollider(FFloat(0, 5)));
+            }
+            else
+            {
+                body->addCollider(new FPolygonCollider(FFloat(1), FFloat(1)));
+            }
+            body->setContinuousCollision(c % 4 == 0);
+            body->setBodyPosition(FVector3(FFloat(c * 5 - 20) + FFloat(0, 3) * (i % 2), FFloat(0), FFloat(i) + FFloat(0, 5)));
+            physics->addRigidbody(body);
+            bodies.push_back(body);
+        }
+    }
+}
+
+/** 每一帧的输入。回滚重放时输入相同，结果才能相同 */
+static void stepTestScene(FPhysics2D *physics, std::vector<FRigidbodyPtr> &bodies, int frame)
+{
+    if (frame % 7 == 0)
+    {
+        bodies[(frame * 13) % bodies.size()]->setBodyVelocity(FVector3(3, 0, 6));
+    }
+    physics->tick(TEST_DELTA_TIME);
+}
+
+/** 收集刚体和碰撞对的原始定点数值，逐位比较 */
+static void captureTestScene(FPhysics2D *physics, std::vector<FRigidbodyPtr> &bodies, std::vector<int> &values)
+{
+    values.clear();
+    for (FRigidbodyPtr &body : bodies)
+    {
+        const FVector3 &position = body->getBodyPosition();
+        const FVector3 &velocity = body->getBodyVelocity();
+        values.push_back(position.x.value);
+        values.push_back(position.z.value);
+        values.push_back(body->getBodyAngle().value);
+        values.push_back(velocity.x.value);
+        values.push_back(velocity.z.value);
+        values.push_back(body->getAngleVelocity().value);
+        values.push_back(body->isActive() ? 1 : 0);
+    }
+
+    for (auto &pair : physics->getColliderPairs())
+    {
+        const FCollisionInfo &info = pair.second.collisionInfo;
+        values.push_back((int)pair.first);
+        values.push_back(info.pointCount);
+        for (int i = 0; i < info.pointCount; ++i)
+        {
+            values.push_back(info.points[i].forceNormal.value);
+            values.push_back(info.points[i].forceTangent.value);
+        }
+    }
+    values.push_back((int)physics->getActiveRigidbodyCount());
+}
+
+/** 恢复之后执行N帧，与不中断地执行N帧的结果逐位相同 */
+static void testRestoreState()
+{
+    SmartPtr<FPhysics2D> physics = new FPhysics2D();
+    physics->init();
+    std::vector<FRigidbodyPtr> bodies;
+    buildTestScene(physics.get(), bodies);
+
+    int frame = 0;
+    for (; frame < 30; ++frame)
+    {
+        stepTestScene(physics.get(), bodies, frame);
+    }
+
+    FWorldState state;
+    physics->saveState(state);
+
+    const int count = 40;
+    std::vector<std::vector<int>> expected(count);
+    for (int i = 0; i < count; ++i)
+    {
+        stepTestScene(physics.get(), bodies, frame + i);
+        captureTestScene(physics.get(), bodies, expected[i]);
+    }
+
+    // 回滚两次，第二次中途停下，检查重复恢复同一个状态
+    std::vector<int> values;
+    for (int round = 0; round < 2; ++round)
+    {
+        LS_TEST(physics->restoreState(state));
+        LS_TEST_CMP(physics->getTickStamp(), state.getTickStamp());
+
+        int n = round == 0 ? count : count / 2;
+        for (int i = 0; i < n; ++i)
+        {
+            stepTestScene(physics.get(), bodies, frame + i);
+            captureTestScene(physics.get(), bodies, values);
+            if (!LS_TEST_DESC(values == expected[i], "restore + N ticks == N ticks"))
+            {
+                LOG_ERROR("restore round %d diverged at tick %d", round, i);
+                break;
+            }
+        }
+    }
+
+    // 修改刚体类型后恢复失败，物理世界保持不变
+    bodies.back()->setStatic(true);
+    captureTestScene(physics.get(), bodies, expected[0]);
+    LS_TEST(!physics->restoreState(state));
+    captureTestScene(physics.get(), bodies, values);
+    LS_TEST_DESC(values == expected[0], "failed restore leaves the world unchanged");
+    bodies.clear();
+}
+
+/** resimulate(dt, n)与n次tick的结果逐位相同 */
+static void testResimulate()
+{
+    SmartPtr<FPhysics2D> physics = new FPhysics2D();
+    physics->init();
+    physics->setQuerySnapshotEnable(true);
+    std::vector<FRigidbodyPtr> bodies;
+    buildTestScene(physics.get(), bodies);
+
+    for (int frame = 0; frame < 20; ++frame)
+    {
+        stepTestScene(physics.get(), bodies, frame);
+    }
+
+    FWorldState state;
+    physics->saveState(state);
+
+    const int count = 30;
+    std::vector<int> expected;
+    for (int i = 0; i < count; ++i)
+    {
+        physics->tick(TEST_DELTA_TIME);
+    }
+    captureTestScene(physics.get(), bodies, expected);
+
+    // 紧接着追帧，不需要恢复时发布快照
+    LS_TEST(physics->restoreState(state, false));
+    physics->resimulate(TEST_DELTA_TIME, count);
+    LS_TEST(!physics->isResimulating());
+    LS_TEST_CMP(physics->getTickStamp(), state.getTickStamp() + count);
+
+    std::vector<int> values;
+    captureTestScene(physics.get(), bodies, values);
+    LS_TEST_DESC(values == expected, "resimulate(dt, n) == n ticks");
+    LS_TEST_CMP(physics->getQuerySnapshot()->getTickStamp(), physics->getTickStamp());
+    bodies.clear();
+}
+
+/** 着色求解时，SSE4.1的向量求解与逐行标量求解的结果逐位相同 */
+static void testContactSolverSimd()
+{
+    if (!FContactSolver::isSimdSupported())
+    {
+        LOG_DEBUG("SSE4.1 contact solver is not compiled, skip the comparison.");
+    }
+
+    std::vector<std::vector<int>> results[2];
+    for (int simd = 0; simd < 2; ++simd)
+    {
+        SmartPtr<FPhysics2D> physics = new FPhysics2D();
+        physics->init();
+        physics->setSolverThreadCount(1);
+        physics->getContactSolver()->setSimdEnabled(simd != 0);
+        std::vector<FRigidbodyPtr> bodies;
+        buildTestScene(physics.get(), bodies);
+
+        std::vector<std::vector<int>> &values = results[simd];
+        values.resize(60);
+        for (int frame = 0; frame < 60; ++frame)
+        {
+            stepTestScene(physics.get(), bodies, frame);
+            captureTestScene(physics.get(), bodies, values[frame]);
+        }
+        bodies.clear();
+    }
+
+    for (size_t i = 0; i < results[0].size(); ++i)
+    {
+        if (!LS_TEST_DESC(results[0][i] == results[1][i], "SSE4.1 solver == scalar solver"))
+        {
+            LOG_ERROR("SSE4.1 solver diverged at tick %d", (int)i);
+            break;
+        }
+    }
+}
+
+FXP_API void testFPhysics()
+{
+    testRestoreState();
+    testResimulate();
+    testContactSolverSimd();
+}
+
+NS_FXP_END
@@ -81,6 +81,9 @@ public:
     /** 获取射线到包围盒的距离 */
     FFloat getDistance(const FVector2 & start, const FVector2 & end) const;
 
+    /** 获取点到包围盒的距离。点在包围盒内部时为0 */
+    FFloat getDistanceToPoint(const FVector2 & point) const;
+
     void applyMatrix(const FMatrix2D & mat);
     void applyMatrix(FBB & out, const FMatrix2D & mat) const;
 
@@ -158,6 +161,21 @@ inline void FBB::getCenter(FVector2 & center) const
     center = (max + min) / FFloat(2);
 }
 
+inline FFloat FBB::getDistanceToPoint(const FVector2 & point) const
+{
+    FFloat dx = FMath::max(FMath::max(min.x - point.x, point.x - max.x), FFloat(0));
+    FFloat dy = FMath::max(FMath::max(min.y - point.y, point.y - max.y), FFloat(0));
+    if (dx == 0)
+    {
+        return dy;
+    }
+    if (dy == 0)
+    {
+        return dx;
+    }
+    return FVector2(dx, dy).length();
+}
+
 inline FVector2 FBB::getDiameter() const
 {
     return max - min;
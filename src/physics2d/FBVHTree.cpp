@@ -32,12 +32,13 @@ static inline void mergeBB(FBB &output, const FBB &a, const FBB &b)
 }
 
 
-// 自底向上更新包围盒
+// 自底向上更新包围盒和统计数据
 static void updateBBBottomUp(FBVHNode *node)
 {
     while (node)
     {
         mergeBB(node->bb, node->left->bb, node->right->bb);
+        node->updateCounts();
         node = node->parent;
     }
 }
@@ -88,6 +89,7 @@ void FBVHTree::addCollider(FCollider* collider)
     }
 
     ++changedCount_;
+    markChanged();
 
     if (root == nullptr)
     {
@@ -160,6 +162,7 @@ bool FBVHTree::removeCollider(FCollider * collider)
     }
 
     ++changedCount_;
+    markChanged();
 
     FBVHNode *node = it->second;
     assert(node->isLeafNode());
@@ -231,6 +234,68 @@ void FBVHTree::updateCollider(FCollider *collider)
     collider->release();
 }
 
+void FBVHTree::updateColliderLayer(FCollider *collider)
+{
+    auto it = colliderMap.find(collider);
+    if (it == colliderMap.end())
+    {
+        return;
+    }
+
+    markChanged();
+
+    FBVHNode *node = it->second;
+    node->updateLeafLayer();
+
+    for (node = node->parent; node != nullptr; node = node->parent)
+    {
+        node->updateCounts();
+    }
+}
+
+int FBVHTree::countColliders(const FBB &bounds, uint32_t layerMask)
+{
+    if (nullptr == root)
+    {
+        return 0;
+    }
+
+    int count = 0;
+
+    stack.clear();
+    stack.push_back(FBVHQueryNode(root, bounds));
+
+    while (!stack.empty())
+    {
+        FBVHNode *node = stack.back().node;
+        stack.pop_back();
+
+        if ((node->layers & layerMask) == 0 || !node->bb.intersect(bounds))
+        {
+            continue;
+        }
+
+        if (node->isLeafNode())
+        {
+            // node->bb是向外扩展了的，需要用collider的bb精确判断
+            if (node->collider->getBounds().intersect(bounds))
+            {
+                ++count;
+            }
+        }
+        else if ((node->layers & ~layerMask) == 0 && bounds.contians(node->bb))
+        {
+            count += node->leafCount;
+        }
+        else
+        {
+            stack.push_back(FBVHQueryNode(node->left, bounds));
+            stack.push_back(FBVHQueryNode(node->right, bounds));
+        }
+    }
+    return count;
+}
+
 void FBVHTree::clear()
 {
     if (nullptr != root)
@@ -241,6 +306,7 @@ void FBVHTree::clear()
 
     colliderMap.clear();
     changedCount_ = 0;
+    markChanged();
 }
 
 void FBVHTree::clearNode(FBVHNode *node)
@@ -389,6 +455,19 @@ struct OPSortNodes
     }
 };
 
+// 按先序收集叶结点
+static void collectLeafNodes(FBVHNode *node, std::vector<FBVHNode*> &nodes)
+{
+    if (node->isLeafNode())
+    {
+        nodes.push_back(node);
+        return;
+    }
+
+    collectLeafNodes(node->left, nodes);
+    collectLeafNodes(node->right, nodes);
+}
+
 void FBVHTree::rebuild()
 {
     changedCount_ = 0;
@@ -397,11 +476,13 @@ void FBVHTree::rebuild()
         return;
     }
 
+    markChanged();
+
+    // 不遍历colliderMap。unordered_map的遍历顺序与插入历史有关，恢复状态后可能不同，
+    // 而排序时中心点相同的结点保持输入顺序，会导致重建出的树不一致
     std::vector<FBVHNode*> nodes;
-    for (auto &pair : colliderMap)
-    {
-        nodes.push_back(pair.second);
-    }
+    nodes.reserve(colliderMap.size());
+    collectLeafNodes(root, nodes);
 
     releaseNoneLeafNodes(root);
     root = nullptr;
@@ -451,4 +532,97 @@ FBVHNode* FBVHTree::rebuild(FBVHNode **start, FBVHNode **end, int axis)
     return node;
 }
 
+static int saveNodeState(FBVHNode *node, std::vector<FBVHNodeState> &nodes)
+{
+    int index = (int)nodes.size();
+    nodes.push_back(FBVHNodeState());
+
+    // 递归会使nodes重新分配内存，子结点保存完之后再通过索引访问
+    int left = -1;
+    int right = -1;
+    if (!node->isLeafNode())
+    {
+        left = saveNodeState(node->left, nodes);
+        right = saveNodeState(node->right, nodes);
+    }
+
+    FBVHNodeState &state = nodes[index];
+    state.bb = node->bb;
+    state.left = left;
+    state.right = right;
+    state.collider = node->collider.get();
+    state.leafCount = node->leafCount;
+    state.layers = node->layers;
+    return index;
+}
+
+void FBVHTree::saveState(FBVHTreeState &state)
+{
+    state.changedCount = changedCount_;
+    if (state.version == version_)
+    {
+        return;
+    }
+
+    state.version = version_;
+    state.nodes.clear();
+    if (root != nullptr)
+    {
+        saveNodeState(root, state.nodes);
+    }
+}
+
+void FBVHTree::restoreState(const FBVHTreeState &state)
+{
+    changedCount_ = state.changedCount;
+    if (state.version == version_)
+    {
+        return;
+    }
+
+    if (nullptr != root)
+    {
+        clearNode(root);
+        root = nullptr;
+    }
+
+    // 碰撞体集合不变时，只更新映射的结点，不需要重新分配内存
+    if (colliderMap.size() != (state.nodes.size() + 1) / 2)
+    {
+        colliderMap.clear();
+    }
+
+    if (!state.nodes.empty())
+    {
+        root = restoreNode(state.nodes, 0, nullptr);
+    }
+
+    version_ = state.version;
+}
+
+FBVHNode* FBVHTree::restoreNode(const std::vector<FBVHNodeState> &nodes, int index, FBVHNode *parent)
+{
+    const FBVHNodeState &state = nodes[index];
+
+    FBVHNode *node = createNode();
+    node->bb = state.bb;
+    node->parent = parent;
+    node->collider = state.collider;
+    node->leafCount = state.leafCount;
+    node->layers = state.layers;
+
+    if (state.collider != nullptr)
+    {
+        node->left = nullptr;
+        node->right = nullptr;
+        colliderMap[state.collider] = node;
+    }
+    else
+    {
+        node->left = restoreNode(nodes, state.left, node);
+        node->right = restoreNode(nodes, state.right, node);
+    }
+    return node;
+}
+
 NS_FXP_END
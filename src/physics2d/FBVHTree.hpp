@@ -12,6 +12,8 @@
 #include "debug/LogTool.hpp"
 #include "debug/Profiler.hpp"
 
+#include <algorithm>
+#include <cassert>
 #include <unordered_map>
 #include <bitset>
 #include <string>
@@ -32,6 +34,10 @@ public:
     FBVHNode* right = nullptr;
     /** 碰撞体。如果碰撞体不为空，则当前结点是叶结点；否则，不是叶结点，必定有两个子结点*/
     SmartPtr<FCollider> collider;
+    /** 子树中layer不为0的叶结点数量。layer为0的碰撞体不会被任何layer查询匹配到 */
+    int leafCount = 0;
+    /** 子树中所有碰撞体layer的并集 */
+    uint32_t layers = 0;
 
     void setAsLeaf(FCollider *collider, const FBB &bb)
     {
@@ -39,6 +45,20 @@ public:
         left = nullptr;
         right = nullptr;
         this->bb = bb;
+        updateLeafLayer();
+    }
+
+    void updateLeafLayer()
+    {
+        layers = collider->getLayer();
+        leafCount = layers != 0 ? 1 : 0;
+    }
+
+    /** 从子结点合并统计数据 */
+    void updateCounts()
+    {
+        leafCount = left->leafCount + right->leafCount;
+        layers = left->layers | right->layers;
     }
 
     void setAsNode(FBVHNode *left, FBVHNode *right)
@@ -49,6 +69,7 @@ public:
 
         bb = left->bb;
         bb.add(right->bb);
+        updateCounts();
 
         left->parent = this;
         right->parent = this;
@@ -65,6 +86,8 @@ struct FBVHQueryNode
     FBVHNode *node;
     FBB bb;
     FFloat distance;
+    /** 射线包查询时，仍需要检测的射线 */
+    uint32_t mask = 0;
 
     FBVHQueryNode() = default;
 
@@ -75,6 +98,32 @@ struct FBVHQueryNode
     FBVHQueryNode(FBVHNode *n, FFloat d)
         : node(n), distance(d)
     {}
+
+    FBVHQueryNode(FBVHNode *n, uint32_t m)
+        : node(n), mask(m)
+    {}
+};
+
+/** 结点的状态。子结点使用在FBVHTreeState::nodes中的索引，叶结点的left和right为-1 */
+struct FBVHNodeState
+{
+    FBB bb;
+    int left;
+    int right;
+    /** 不增加引用计数。恢复时碰撞体必须仍在树中 */
+    FCollider *collider;
+    int leafCount;
+    uint32_t layers;
+};
+
+/** 树的状态，用于回滚。结点按先序排列，根结点在0号位置 */
+class FBVHTreeState
+{
+public:
+    std::vector<FBVHNodeState> nodes;
+    /** 保存时树的版本号 */
+    uint32_t version = 0;
+    int changedCount = 0;
 };
 
 /** 层次包围盒树。是一颗满二叉树 */
@@ -82,6 +131,9 @@ class FXP_API FBVHTree
 {
     DISABLE_COPY_AND_ASSIGN(FBVHTree);
 public:
+    /** 射线包最多包含的射线数量 */
+    static const int RAY_PACKET_SIZE = 32;
+
     FBVHTree();
     ~FBVHTree();
 
@@ -90,6 +142,8 @@ public:
     void addCollider(FCollider* collider);
     bool removeCollider(FCollider* collider);
     void updateCollider(FCollider *collider);
+    /** 碰撞体的layer发生了变化，更新结点的统计数据 */
+    void updateColliderLayer(FCollider *collider);
 
     /** 清空整个树 */
     void clear();
@@ -102,12 +156,54 @@ public:
     size_t getLeafeCount() { return colliderMap.size(); }
     int getChangedCount() { return changedCount_; }
 
+    /** 统计包围盒与bounds相交、且layer & layerMask不为0的碰撞体数量。
+     *  完全包含在bounds内、且所有layer都在layerMask内的子树，直接累加叶结点数量，不再向下查找。
+     */
+    int countColliders(const FBB &bounds, uint32_t layerMask);
+
     /** 根据包围盒范围查询碰撞体。如果visit函数返回true，则终止查询；否则继续查找下一个匹配的碰撞体。*/
     template<typename T>
     bool queryCollider(const FBB & bb, T &visit);
+
+    /** 使用调用者提供的栈查询，不修改树的任何状态。树不发生变化时，可以在多个线程中同时调用 */
+    template<typename T>
+    bool queryCollider(const FBB & bb, T &visit, std::vector<FBVHQueryNode> &queryStack) const;
     
     template<typename T>
     void queryByRay(const FVector2 &start, const FVector2 &direction, FFloat distance, T &visit);
+    template<typename T>
+    void queryByRay(const FVector2 &start, const FVector2 &direction, FFloat distance, T &visit, std::vector<FBVHQueryNode> &queryStack) const;
+
+    /** 最近邻查询。按离point由近到远的顺序(best-first)访问叶结点，跳过离point超过radius的结点。
+     *  visit(node)返回新的搜索半径，之后只访问更近的结点。
+     */
+    template<typename T>
+    void queryNearest(const FVector2 &point, FFloat radius, T &visit);
+
+    /** 查询与线段相交的任意一个碰撞体，不要求最近。visit返回true则立即终止查询，并返回true */
+    template<typename T>
+    bool queryAnyByRay(const FVector2 &start, const FVector2 &end, T &visit);
+    template<typename T>
+    bool queryAnyByRay(const FVector2 &start, const FVector2 &end, T &visit, std::vector<FBVHQueryNode> &queryStack) const;
+
+    /** 扇形查询。扇形以origin为圆心，朝向forward(单位向量)，半径为radius，半角为halfAngle度。
+     *  跳过离origin超过radius、或者完全在扇形两条边外侧的结点。visit返回true则立即终止查询，并返回true
+     */
+    template<typename T>
+    bool queryBySector(const FVector2 &origin, const FVector2 &forward, FFloat radius, FFloat halfAngle, T &visit);
+
+    /** 射线包查询。一次遍历同时查询count条射线，每个结点只出栈一次，与整个射线包的包围盒不相交的结点直接跳过。
+     *  visit(node, i)返回第i条射线与结点碰撞体的距离。距离更近时会缩短rays[i]，之后只查询更近的结点。
+     *  返回值不大于0时，第i条射线结束查询。
+     */
+    template<typename T>
+    void queryByRayPacket(FRay *rays, int count, T &visit);
+
+    /** 圆形包查询。一次遍历同时查询count个圆，count不超过RAY_PACKET_SIZE。
+     *  每个结点只出栈一次，只对与结点包围盒相交的圆调用visit(node, i)
+     */
+    template<typename T>
+    void queryByCirclePacket(const FVector2 *centers, const FFloat *radii, int count, T &visit);
 
     void debugDraw();
     
@@ -116,6 +212,16 @@ public:
     /** 构造较慢，查询很快。适合静态物体 */
     void rebuild();
 
+    /** 版本号。树的结构或结点数据发生变化时，会更新为一个从未使用过的值 */
+    uint32_t getVersion() const { return version_; }
+
+    /** 保存树的状态。state保存的版本号与当前相同时，不重复拷贝 */
+    void saveState(FBVHTreeState &state);
+    /** 恢复树的状态。版本号相同时只恢复changedCount，否则按结点数组重新链接整棵树。
+     *  state中的碰撞体必须与树中当前的碰撞体相同
+     */
+    void restoreState(const FBVHTreeState &state);
+
     void setEdgeCoef(FFloat coef) { edgeCoef = coef; }
     FFloat getEdgeCoef() const { return edgeCoef; }
 
@@ -129,6 +235,9 @@ private:
     FBVHNode* createLeaf(FCollider *collider);
 
     FBVHNode* rebuild(FBVHNode **start, FBVHNode **end, int axis);
+    FBVHNode* restoreNode(const std::vector<FBVHNodeState> &nodes, int index, FBVHNode *parent);
+
+    void markChanged() { version_ = ++nextVersion_; }
     void releaseNoneLeafNodes(FBVHNode *node);
     
     template<typename T>
@@ -146,6 +255,10 @@ private:
 
     int changedCount_ = 0;
 
+    uint32_t version_ = 0;
+    /** 版本号分配器，恢复状态时不会回退，保证同一个版本号只对应一种树的状态 */
+    uint32_t nextVersion_ = 0;
+
     // 包围盒的边界尺寸。将包围盒向外扩展一点，避免位置频繁变动引起树的重建。
     FFloat  edgeCoef = FFloat(0, 1);
 
@@ -156,19 +269,25 @@ private:
 
 template<typename T>
 bool FBVHTree::queryCollider(const FBB & bounds, T &visit)
+{
+    return queryCollider(bounds, visit, stack);
+}
+
+template<typename T>
+bool FBVHTree::queryCollider(const FBB & bounds, T &visit, std::vector<FBVHQueryNode> &queryStack) const
 {
     if (nullptr == root)
     {
         return false;
     }
 
-    stack.clear();
-    stack.push_back(FBVHQueryNode(root, bounds));
+    queryStack.clear();
+    queryStack.push_back(FBVHQueryNode(root, bounds));
 
-    while (!stack.empty())
+    while (!queryStack.empty())
     {
-        FBVHQueryNode top = stack.back();
-        stack.pop_back();
+        FBVHQueryNode top = queryStack.back();
+        queryStack.pop_back();
 
         FBVHNode *node = top.node;
         if (!node->bb.intersect(top.bb))
@@ -189,8 +308,8 @@ bool FBVHTree::queryCollider(const FBB & bounds, T &visit)
             FBB tempBB = top.bb;
             tempBB.sub(node->bb);
 
-            stack.push_back(FBVHQueryNode(node->left, tempBB));
-            stack.push_back(FBVHQueryNode(node->right, tempBB));
+            queryStack.push_back(FBVHQueryNode(node->left, tempBB));
+            queryStack.push_back(FBVHQueryNode(node->right, tempBB));
         }
     }
     return false;
@@ -198,6 +317,12 @@ bool FBVHTree::queryCollider(const FBB & bounds, T &visit)
 
 template<typename T>
 void FBVHTree::queryByRay(const FVector2 &start, const FVector2 &direction, FFloat distance, T &visit)
+{
+    queryByRay(start, direction, distance, visit, stack);
+}
+
+template<typename T>
+void FBVHTree::queryByRay(const FVector2 &start, const FVector2 &direction, FFloat distance, T &visit, std::vector<FBVHQueryNode> &queryStack) const
 {
     if (nullptr == root)
     {
@@ -206,8 +331,8 @@ void FBVHTree::queryByRay(const FVector2 &start, const FVector2 &direction, FFlo
 
     FBB unused;
 
-    stack.clear();
-    stack.push_back(FBVHQueryNode(root, distance));
+    queryStack.clear();
+    queryStack.push_back(FBVHQueryNode(root, distance));
 
     FVector2 end = start + direction * distance;
     FFloat minDistance = distance;
@@ -216,11 +341,11 @@ void FBVHTree::queryByRay(const FVector2 &start, const FVector2 &direction, FFlo
     FBVHNode *node;
     FFloat d1, d2;
 
-    while (!stack.empty())
+    while (!queryStack.empty())
     {
-        top = stack.back();
+        top = queryStack.back();
         node = top.node;
-        stack.pop_back();
+        queryStack.pop_back();
 
         if (top.distance > minDistance)
         {
@@ -243,11 +368,11 @@ void FBVHTree::queryByRay(const FVector2 &start, const FVector2 &direction, FFlo
             // 射线离左结点包围盒更近，优先检测左结点
             if (d1 < minDistance)
             {
-                stack.push_back(FBVHQueryNode(node->left, d1));
+                queryStack.push_back(FBVHQueryNode(node->left, d1));
             }
             if (d2 < minDistance)
             {
-                stack.push_back(FBVHQueryNode(node->right, d2));
+                queryStack.push_back(FBVHQueryNode(node->right, d2));
             }
         }
         else
@@ -255,13 +380,320 @@ void FBVHTree::queryByRay(const FVector2 &start, const FVector2 &direction, FFlo
             // 射线离右结点包围盒更近，优先检测右结点
             if (d2 < minDistance)
             {
-                stack.push_back(FBVHQueryNode(node->right, d2));
+                queryStack.push_back(FBVHQueryNode(node->right, d2));
             }
             if (d1 < minDistance)
             {
-                stack.push_back(FBVHQueryNode(node->left, d1));
+                queryStack.push_back(FBVHQueryNode(node->left, d1));
+            }
+        }
+    }
+}
+
+/** 最近邻查询使用的小顶堆的比较函数 */
+inline bool compareQueryNodeDistance(const FBVHQueryNode &a, const FBVHQueryNode &b)
+{
+    return a.distance > b.distance;
+}
+
+template<typename T>
+void FBVHTree::queryNearest(const FVector2 &point, FFloat radius, T &visit)
+{
+    if (nullptr == root)
+    {
+        return;
+    }
+
+    // stack当作小顶堆使用，堆顶是离point最近的结点
+    stack.clear();
+    stack.push_back(FBVHQueryNode(root, root->bb.getDistanceToPoint(point)));
+
+    while (!stack.empty())
+    {
+        std::pop_heap(stack.begin(), stack.end(), compareQueryNodeDistance);
+        FBVHQueryNode top = stack.back();
+        stack.pop_back();
+
+        // 剩下的结点都更远
+        if (top.distance > radius)
+        {
+            break;
+        }
+
+        FBVHNode *node = top.node;
+        if (node->isLeafNode())
+        {
+            radius = FMath::min(radius, visit(node));
+            continue;
+        }
+
+        FFloat d1 = node->left->bb.getDistanceToPoint(point);
+        if (d1 <= radius)
+        {
+            stack.push_back(FBVHQueryNode(node->left, d1));
+            std::push_heap(stack.begin(), stack.end(), compareQueryNodeDistance);
+        }
+
+        FFloat d2 = node->right->bb.getDistanceToPoint(point);
+        if (d2 <= radius)
+        {
+            stack.push_back(FBVHQueryNode(node->right, d2));
+            std::push_heap(stack.begin(), stack.end(), compareQueryNodeDistance);
+        }
+    }
+}
+
+template<typename T>
+bool FBVHTree::queryAnyByRay(const FVector2 &start, const FVector2 &end, T &visit)
+{
+    return queryAnyByRay(start, end, visit, stack);
+}
+
+template<typename T>
+bool FBVHTree::queryAnyByRay(const FVector2 &start, const FVector2 &end, T &visit, std::vector<FBVHQueryNode> &queryStack) const
+{
+    if (nullptr == root)
+    {
+        return false;
+    }
+
+    FBB bounds;
+    bounds.resetWithPoint(start, end);
+
+    queryStack.clear();
+    queryStack.push_back(FBVHQueryNode(root, FFloat(0)));
+
+    while (!queryStack.empty())
+    {
+        FBVHNode *node = queryStack.back().node;
+        queryStack.pop_back();
+
+        if (!node->bb.intersect(bounds) || node->bb.getDistance(start, end) == FMath::FloatMax)
+        {
+            continue;
+        }
+
+        if (node->isLeafNode())
+        {
+            if (visit(node))
+            {
+                return true;
+            }
+        }
+        else
+        {
+            queryStack.push_back(FBVHQueryNode(node->right, FFloat(0)));
+            queryStack.push_back(FBVHQueryNode(node->left, FFloat(0)));
+        }
+    }
+    return false;
+}
+
+/** 包围盒在direction方向上离origin最远的投影距离 */
+inline FFloat getSupportDistance(const FBB &bb, const FVector2 &origin, const FVector2 &direction)
+{
+    FFloat x = direction.x >= FFloat(0) ? bb.max.x : bb.min.x;
+    FFloat y = direction.y >= FFloat(0) ? bb.max.y : bb.min.y;
+    return (x - origin.x) * direction.x + (y - origin.y) * direction.y;
+}
+
+template<typename T>
+bool FBVHTree::queryBySector(const FVector2 &origin, const FVector2 &forward, FFloat radius, FFloat halfAngle, T &visit)
+{
+    if (nullptr == root)
+    {
+        return false;
+    }
+
+    // 两条边指向扇形内侧的法线。半角超过90度时，扇形不是凸的，只按半径裁剪
+    bool useEdges = halfAngle <= FFloat(90);
+    FFloat c = FMath::cos(FFloat(90) - halfAngle);
+    FFloat s = FMath::sin(FFloat(90) - halfAngle);
+    FVector2 leftNormal(forward.x * c + forward.y * s, forward.y * c - forward.x * s);
+    FVector2 rightNormal(forward.x * c - forward.y * s, forward.y * c + forward.x * s);
+
+    stack.clear();
+    stack.push_back(FBVHQueryNode(root, FFloat(0)));
+
+    while (!stack.empty())
+    {
+        FBVHNode *node = stack.back().node;
+        stack.pop_back();
+
+        if (node->bb.getDistanceToPoint(origin) > radius)
+        {
+            continue;
+        }
+
+        if (useEdges && (getSupportDistance(node->bb, origin, leftNormal) < FFloat(0) ||
+            getSupportDistance(node->bb, origin, rightNormal) < FFloat(0)))
+        {
+            continue;
+        }
+
+        if (node->isLeafNode())
+        {
+            if (visit(node))
+            {
+                return true;
             }
         }
+        else
+        {
+            stack.push_back(FBVHQueryNode(node->right, FFloat(0)));
+            stack.push_back(FBVHQueryNode(node->left, FFloat(0)));
+        }
+    }
+    return false;
+}
+
+template<typename T>
+void FBVHTree::queryByCirclePacket(const FVector2 *centers, const FFloat *radii, int count, T &visit)
+{
+    if (nullptr == root || count <= 0)
+    {
+        return;
+    }
+    assert(count <= RAY_PACKET_SIZE);
+
+    FBB packetBB;
+    packetBB.reset();
+    uint32_t mask = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        if (radii[i] >= 0)
+        {
+            FVector2 size(radii[i], radii[i]);
+            packetBB.add(centers[i] - size);
+            packetBB.add(centers[i] + size);
+            mask |= 1u << i;
+        }
+    }
+
+    stack.clear();
+    stack.push_back(FBVHQueryNode(root, mask));
+
+    while (!stack.empty())
+    {
+        FBVHQueryNode top = stack.back();
+        stack.pop_back();
+
+        FBVHNode *node = top.node;
+        if (!node->bb.intersect(packetBB))
+        {
+            continue;
+        }
+
+        uint32_t active = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            if ((top.mask & (1u << i)) && node->bb.getDistanceToPoint(centers[i]) <= radii[i])
+            {
+                active |= 1u << i;
+            }
+        }
+
+        if (active == 0)
+        {
+            continue;
+        }
+
+        if (node->isLeafNode())
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                if (active & (1u << i))
+                {
+                    visit(node, i);
+                }
+            }
+        }
+        else
+        {
+            stack.push_back(FBVHQueryNode(node->right, active));
+            stack.push_back(FBVHQueryNode(node->left, active));
+        }
+    }
+}
+
+template<typename T>
+void FBVHTree::queryByRayPacket(FRay *rays, int count, T &visit)
+{
+    if (nullptr == root || count <= 0)
+    {
+        return;
+    }
+    assert(count <= RAY_PACKET_SIZE);
+
+    FBB packetBB;
+    packetBB.reset();
+    uint32_t mask = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        if (rays[i].distance > 0)
+        {
+            packetBB.add(FBB(rays[i]));
+            mask |= 1u << i;
+        }
+    }
+
+    // 已经结束查询的射线
+    uint32_t finished = 0;
+
+    stack.clear();
+    stack.push_back(FBVHQueryNode(root, mask));
+
+    while (!stack.empty())
+    {
+        FBVHQueryNode top = stack.back();
+        stack.pop_back();
+
+        FBVHNode *node = top.node;
+        if (!node->bb.intersect(packetBB))
+        {
+            continue;
+        }
+
+        // 剔除与结点不相交的射线。射线找到更近的碰撞点后会缩短，也会在这里被剔除
+        uint32_t active = 0;
+        uint32_t candidates = top.mask & ~finished;
+        for (int i = 0; i < count; ++i)
+        {
+            if ((candidates & (1u << i)) &&
+                node->bb.getDistance(rays[i].start, rays[i].end) != FMath::FloatMax)
+            {
+                active |= 1u << i;
+            }
+        }
+
+        if (active == 0)
+        {
+            continue;
+        }
+
+        if (node->isLeafNode())
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                if (active & (1u << i))
+                {
+                    FFloat distance = visit(node, i);
+                    if (distance <= 0)
+                    {
+                        finished |= 1u << i;
+                    }
+                    else if (distance < rays[i].distance)
+                    {
+                        rays[i].set(rays[i].start, rays[i].normal, distance);
+                    }
+                }
+            }
+        }
+        else
+        {
+            stack.push_back(FBVHQueryNode(node->right, active));
+            stack.push_back(FBVHQueryNode(node->left, active));
+        }
     }
 }
 
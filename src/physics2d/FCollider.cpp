@@ -13,6 +13,143 @@
 
 NS_FXP_BEGIN
 
+//-------------------------
+// 几何检测
+//-------------------------
+
+bool overlapPointCircle(const FVector2 &center, FFloat radius, const FVector2 &point, FFloat pointRadius)
+{
+    pointRadius += radius;
+    return point.distanceToSq(center) <= pointRadius * pointRadius;
+}
+
+bool overlapPointSegment(const FVector2 &start, const FVector2 &end, const FVector2 &point, FFloat radius)
+{
+    FVector2 ab = end - start;
+    FVector2 ap = point - start;
+    
+    if (ab.isZero())
+    {
+        return point.distanceToSq(ab) <= radius * radius;
+    }
+
+    // 计算point到线段最近点的距离，是否小于radius
+    FFloat projection = ap.dot(ab) / ab.lengthSq();
+    projection = FMath::clamp01(projection);
+    FVector2 crossPt = start + ab * projection;
+    return point.distanceToSq(crossPt) < radius * radius;
+}
+
+bool rayCastCircle(const FVector2 &center, FFloat radius, const FRay &ray, FRaycastHit &hit)
+{
+    // 算法参考: 《3D数学基础-图形与游戏开发》 13.12
+
+    FVector2 e = center - ray.start;
+    
+    // 起点在圆内
+    FFloat eLengthSq = e.lengthSq();
+    if (eLengthSq <= radius * radius)
+    {
+        hit.distance = 0;
+        hit.normal.setXZ(ray.normal);
+        hit.point.setXZ(ray.start);
+        return true;
+    }
+    
+    FFloat a = e.dot(ray.normal);
+
+    FFloat delta = radius * radius - eLengthSq + a * a;
+    // 不相交
+    if (delta < 0)
+    {
+        return false;
+    }
+    
+    FFloat t = a - FMath::sqrt(delta);
+    if (t < FFloat(0) || t > FFloat(ray.distance))
+    {
+        return false;
+    }
+
+    hit.distance = t;
+    hit.normal.setXZ(ray.normal);
+    hit.point.setXZ(ray.start + ray.normal * hit.distance);
+    return true;
+}
+
+bool rayCastSegment(const FVector2 &start, const FVector2 &end, const FRay &ray, FRaycastHit &hit)
+{
+    const FVector2& a = ray.end - ray.start;
+    const FVector2& b = end - start;
+    FVector2 c = start - ray.start;
+    
+    FFloat denominator = a.x * b.y - a.y * b.x;
+    if (denominator == 0)
+    {
+        return false;
+    }
+    
+    FFloat t1 = (c.x * b.y - c.y * b.x) / denominator;
+    FFloat t2 = (c.x * a.y - c.y * a.x) / denominator;
+    if (t1 < FFloat(0) || t1 > FFloat(1) ||
+        t2 < FFloat(0) || t2 > FFloat(1))
+    {
+        return false;
+    }
+    
+    hit.distance = ray.distance * t1;
+    hit.normal.setXZ(ray.normal);
+    hit.point.setXZ(ray.start + ray.normal * hit.distance);
+    return true;
+}
+
+bool rayCastPolygon(const FVector2 *vertices, size_t count, const FRay &ray, FRaycastHit &hit)
+{
+    const FVector2& a = ray.end - ray.start;
+    FFloat tMin = FMath::FloatMax;
+    bool bIntersect = false;
+    
+    for (size_t i = 0; i < count; ++i)
+    {
+        const FVector2& A = vertices[i];
+        const FVector2& B = vertices[(i + 1) % count];
+        
+        FVector2 b = B - A;
+//        b.normalize();
+        FVector2 c = A - ray.start;
+        
+        FFloat denominator = a.x * b.y - a.y * b.x;
+        if (denominator == 0)
+        {
+            continue;
+        }
+        
+        FFloat t1 = (c.x * b.y - c.y * b.x) / denominator;
+        FFloat t2 = (c.x * a.y - c.y * a.x) / denominator;
+        if (t1 < FFloat(0) || t1 > FFloat(1) ||
+            t2 < FFloat(0) || t2 > FFloat(1))
+        {
+            continue;
+        }
+        
+        bIntersect = true;
+        if (t1 < tMin)
+        {
+            tMin = t1;
+        }
+    }
+    
+    if (!bIntersect)
+    {
+        return false;
+    }
+    
+    hit.distance = ray.distance * tMin;
+    hit.normal.setXZ(ray.normal);
+    hit.point.setXZ(ray.start + ray.normal * hit.distance);
+    return true;
+}
+
 static inline Color getColor(FCollider *collider)
 {
     return collider->getRigidbody()->isActive() ? Color::red : Color::green;
@@ -38,6 +175,30 @@ void FCollider::setPhysics(FPhysics2D *physics)
     }
 }
 
+void FCollider::setFilter(const FColliderFilter &filter)
+{
+    uint32_t layer = filter_.layer;
+    filter_ = filter;
+    if (layer != filter.layer && bInPhysics_)
+    {
+        physics_->onColliderLayerChange(this);
+    }
+}
+
+void FCollider::setLayer(uint32_t m)
+{
+    if (filter_.layer == m)
+    {
+        return;
+    }
+
+    filter_.layer = m;
+    if (bInPhysics_)
+    {
+        physics_->onColliderLayerChange(this);
+    }
+}
+
 bool FCollider::canCollideWith(FCollider *collider)
 {
     return this != collider &&
@@ -94,47 +255,17 @@ FVector2 FCircleCollider::getFarthestPointInDirection(const FVector2 & dir)
 
 bool FCircleCollider::overlapPoint(const FVector2 & point, FFloat radius)
 {
-    radius += tRadius_;
-    return point.distanceToSq(tCenter_) <= radius * radius;
+    return overlapPointCircle(tCenter_, tRadius_, point, radius);
 }
 
 bool FCircleCollider::rayCast(const FRay &ray, FRaycastHit &hit)
 {
-    // 算法参考: 《3D数学基础-图形与游戏开发》 13.12
-
-    FVector2 e = tCenter_ - ray.start;
-    
-    // 起点在圆内
-    FFloat eLengthSq = e.lengthSq();
-    if (eLengthSq <= tRadius_ * tRadius_)
+    if (rayCastCircle(tCenter_, tRadius_, ray, hit))
     {
-        hit.distance = 0;
-        hit.normal.setXZ(ray.normal);
-        hit.point.setXZ(ray.start);
         hit.collider = this;
         return true;
     }
-    
-    FFloat a = e.dot(ray.normal);
-
-    FFloat delta = tRadius_ * tRadius_ - eLengthSq + a * a;
-    // 不相交
-    if (delta < 0)
-    {
-        return false;
-    }
-    
-    FFloat t = a - FMath::sqrt(delta);
-    if (t < FFloat(0) || t > FFloat(ray.distance))
-    {
-        return false;
-    }
-
-    hit.distance = t;
-    hit.normal.setXZ(ray.normal);
-    hit.point.setXZ(ray.start + ray.normal * hit.distance);
-    hit.collider = this;
-    return true;
+    return false;
 }
 
 //-------------------------
@@ -196,46 +327,17 @@ FVector2 FSegmentCollider::getFarthestPointInDirection(const FVector2 & dir)
 
 bool FSegmentCollider::overlapPoint(const FVector2 & point, FFloat radius)
 {
-    FVector2 ab = tEnd - tStart;
-    FVector2 ap = point - tStart;
-    
-    if (ab.isZero())
-    {
-        return point.distanceToSq(ab) <= radius * radius;
-    }
-
-    // 计算point到线段最近点的距离，是否小于radius
-    FFloat projection = ap.dot(ab) / ab.lengthSq();
-    projection = FMath::clamp01(projection);
-    FVector2 crossPt = tStart + ab * projection;
-    return point.distanceToSq(crossPt) < radius * radius;
+    return overlapPointSegment(tStart, tEnd, point, radius);
 }
 
 bool FSegmentCollider::rayCast(const FRay &ray, FRaycastHit &hit)
 {
-    const FVector2& a = ray.end - ray.start;
-    const FVector2& b = tEnd - tStart;
-    FVector2 c = tStart - ray.start;
-    
-    FFloat denominator = a.x * b.y - a.y * b.x;
-    if (denominator == 0)
-    {
-        return false;
-    }
-    
-    FFloat t1 = (c.x * b.y - c.y * b.x) / denominator;
-    FFloat t2 = (c.x * a.y - c.y * a.x) / denominator;
-    if (t1 < FFloat(0) || t1 > FFloat(1) ||
-        t2 < FFloat(0) || t2 > FFloat(1))
+    if (rayCastSegment(tStart, tEnd, ray, hit))
     {
-        return false;
+        hit.collider = this;
+        return true;
     }
-    
-    hit.distance = ray.distance * t1;
-    hit.normal.setXZ(ray.normal);
-    hit.point.setXZ(ray.start + ray.normal * hit.distance);
-    hit.collider = this;
-    return true;
+    return false;
 }
 
 //-------------------------
@@ -290,6 +392,29 @@ void FPolygonCollider::updateTransform()
         tVertices[i] = point;
         bb_.add(point);
     }
+
+    // 缩放可能为负数，顶点顺序需要在变换之后判断
+    size_t count = tVertices.size();
+    FFloat area = FFloat(0);
+    for (size_t i = 0; i < count; ++i)
+    {
+        area += tVertices[i].cross(tVertices[(i + 1) % count]);
+    }
+    clockwise_ = area < FFloat(0);
+
+    // 预计算边法线，用于support点的爬山查找
+    for (size_t i = 0; i < count; ++i)
+    {
+        FVector2 edge = tVertices[(i + 1) % count] - tVertices[i];
+        if (clockwise_)
+        {
+            tNormals[i].set(-edge.y, edge.x);
+        }
+        else
+        {
+            tNormals[i].set(edge.y, -edge.x);
+        }
+    }
 }
 
 void FPolygonCollider::debugDraw()
@@ -301,6 +426,7 @@ void FPolygonCollider::setVertices(const FVector2 * pVertices, size_t count, boo
 {
     vertices.resize(count);
     tVertices.resize(count);
+    tNormals.resize(count);
 
     for (size_t i = 0; i < count; ++i)
     {
@@ -317,6 +443,7 @@ void FPolygonCollider::setVertices(const FVector3 * pVertices, size_t count, boo
 {
     vertices.resize(count);
     tVertices.resize(count);
+    tNormals.resize(count);
 
     for (size_t i = 0; i < count; ++i)
     {
@@ -334,7 +461,7 @@ FVector2 FPolygonCollider::getFirstVertex()
     return tVertices[0];
 }
 
-FVector2 FPolygonCollider::getFarthestPointInDirection(const FVector2 & dir)
+int FPolygonCollider::findFarthestIndex(const FVector2 & dir)
 {
     FFloat maxDistance = FMath::FloatMin;
     size_t maxIndex = 0;
@@ -347,60 +474,72 @@ FVector2 FPolygonCollider::getFarthestPointInDirection(const FVector2 & dir)
             maxIndex = i;
         }
     }
-    return tVertices[maxIndex];
+    return (int)maxIndex;
 }
 
-bool FPolygonCollider::overlapPoint(const FVector2 & point, FFloat radius)
+FVector2 FPolygonCollider::getFarthestPointInDirection(const FVector2 & dir)
 {
-    return containsPoint(tVertices.data(), tVertices.size(), point);
+    return tVertices[findFarthestIndex(dir)];
 }
 
-bool FPolygonCollider::rayCast(const FRay &ray, FRaycastHit &hit)
+/** 顶点在dir上的投影，保留乘法的全部精度 */
+static inline int64_t getExactProjection(const FVector2 &v, const FVector2 &dir)
 {
-    const FVector2& a = ray.end - ray.start;
-    FFloat tMin = FMath::FloatMax;
-    bool bIntersect = false;
-    
-    for (size_t i = 0; i < tVertices.size(); ++i)
+    return int64_t(v.x.value) * dir.x.value + int64_t(v.y.value) * dir.y.value;
+}
+
+FVector2 FPolygonCollider::getFarthestPointWithHint(const FVector2 & dir, int & hint)
+{
+    int count = (int)tVertices.size();
+    if (hint < 0 || hint >= count || count < 3)
     {
-        const FVector2& A = tVertices[i];
-        const FVector2& B = tVertices[(i + 1) % tVertices.size()];
-        
-        FVector2 b = B - A;
-//        b.normalize();
-        FVector2 c = A - ray.start;
-        
-        FFloat denominator = a.x * b.y - a.y * b.x;
-        if (denominator == 0)
+        hint = findFarthestIndex(dir);
+        return tVertices[hint];
+    }
+
+    // 凸多边形上，顶点在dir上的投影是单峰的。从上次的顶点出发，沿着投影增大的方向爬山。
+    // 投影使用不舍入的int64比较。舍入后相邻顶点的投影可能相等，爬山会停在最大值之前
+    int index = hint;
+    int64_t projection = getExactProjection(tVertices[index], dir);
+    for (int step = 0; step < count; ++step)
+    {
+        int next = index + 1 < count ? index + 1 : 0;
+        int64_t nextProjection = getExactProjection(tVertices[next], dir);
+        if (nextProjection > projection)
         {
+            index = next;
+            projection = nextProjection;
             continue;
         }
-        
-        FFloat t1 = (c.x * b.y - c.y * b.x) / denominator;
-        FFloat t2 = (c.x * a.y - c.y * a.x) / denominator;
-        if (t1 < FFloat(0) || t1 > FFloat(1) ||
-            t2 < FFloat(0) || t2 > FFloat(1))
+
+        int prev = index > 0 ? index - 1 : count - 1;
+        int64_t prevProjection = getExactProjection(tVertices[prev], dir);
+        if (prevProjection > projection)
         {
+            index = prev;
+            projection = prevProjection;
             continue;
         }
-        
-        bIntersect = true;
-        if (t1 < tMin)
-        {
-            tMin = t1;
-        }
+        break;
     }
-    
-    if (!bIntersect)
+
+    hint = index;
+    return tVertices[index];
+}
+
+bool FPolygonCollider::overlapPoint(const FVector2 & point, FFloat radius)
+{
+    return containsPoint(tVertices.data(), tVertices.size(), point);
+}
+
+bool FPolygonCollider::rayCast(const FRay &ray, FRaycastHit &hit)
+{
+    if (rayCastPolygon(tVertices.data(), tVertices.size(), ray, hit))
     {
-        return false;
+        hit.collider = this;
+        return true;
     }
-    
-    hit.distance = ray.distance * tMin;
-    hit.normal.setXZ(ray.normal);
-    hit.point.setXZ(ray.start + ray.normal * hit.distance);
-    hit.collider = this;
-    return true;
+    return false;
 }
 
 void FPolygonCollider::convertToConvex()
@@ -414,7 +553,8 @@ size_t FPolygonCollider::getMemorySize()
 {
     return FCollider::getMemorySize() +
         vertices.capacity() * sizeof(FVector3) +
-        tVertices.capacity() * sizeof(FVector2);
+        tVertices.capacity() * sizeof(FVector2) +
+        tNormals.capacity() * sizeof(FVector2);
 }
 
 NS_FXP_END
@@ -32,6 +32,10 @@ public:
 
     virtual FVector2 getFirstVertex() = 0;
     virtual FVector2 getFarthestPointInDirection(const FVector2 &dir) = 0;
+    /** 带起点提示的support查询。
+     *  @param hint 上次查询返回的顶点索引，小于0表示没有提示。查询完成后更新为本次的顶点索引。
+     */
+    virtual FVector2 getFarthestPointWithHint(const FVector2 &dir, int &hint) { return getFarthestPointInDirection(dir); }
     virtual bool overlapPoint(const FVector2 &point, FFloat radius) = 0;
     virtual bool rayCast(const FRay &ray, FRaycastHit &hit) = 0;
     
@@ -70,7 +74,7 @@ public:
     /** @brief 设置碰撞过滤器，用于判断Collider可以和哪种Collider发生碰撞。
      *  @param filter   碰撞过滤器。@see FColliderFilter, getFilter
      */
-    inline void setFilter(const FColliderFilter &filter){ filter_ = filter; }
+    void setFilter(const FColliderFilter &filter);
     /// 获取碰撞过滤器。@see ColliderFilter, setFilter
     inline const FColliderFilter& getFilter(){ return filter_; }
     
@@ -80,7 +84,7 @@ public:
     inline uint32_t getGroup(){ return filter_.group; }
     
     /// 设置碰撞过滤器的层属性。如果自己的layer & 别人的mask 不为0，则会发生碰撞。@see setFilter
-    inline void setLayer(uint32_t m) { filter_.layer = m; }
+    void setLayer(uint32_t m);
     /// 获取碰撞过滤器的层属性。@see setFilter, setLayer
     inline uint32_t getLayer(){ return filter_.layer; }
     
@@ -226,20 +230,38 @@ public: // 内部方法
     void debugDraw() override;
 
     const FVector2* getWorldVertices() { return tVertices.data(); }
+    /** 变换后的边法线(未单位化，朝外)。第i个法线对应边(i, i + 1) */
+    const FVector2* getWorldNormals() { return tNormals.data(); }
 
     virtual FVector2 getFirstVertex() override;
     virtual FVector2 getFarthestPointInDirection(const FVector2 &dir) override;
+    virtual FVector2 getFarthestPointWithHint(const FVector2 &dir, int &hint) override;
     virtual bool overlapPoint(const FVector2 &point, FFloat radius) override;
     virtual bool rayCast(const FRay &ray, FRaycastHit &hit) override;
     
 private:
     void convertToConvex();
+
+    int findFarthestIndex(const FVector2 &dir);
     
     /** 原始顶点数据  */
     std::vector<FVector3> vertices;
     
     /** 变换后的顶点数组 */
     std::vector<FVector2> tVertices;
+
+    /** 变换后的边法线(未单位化，朝外)。tNormals[i]对应边(i, i + 1) */
+    std::vector<FVector2> tNormals;
+
+    /** 变换后的顶点是否是顺时针排列 */
+    bool clockwise_ = false;
 };
 
+/** 以下是不依赖碰撞体对象的几何检测，供碰撞体和查询快照共用。射线检测不会设置hit.collider */
+bool overlapPointCircle(const FVector2 &center, FFloat radius, const FVector2 &point, FFloat pointRadius);
+bool overlapPointSegment(const FVector2 &start, const FVector2 &end, const FVector2 &point, FFloat radius);
+bool rayCastCircle(const FVector2 &center, FFloat radius, const FRay &ray, FRaycastHit &hit);
+bool rayCastSegment(const FVector2 &start, const FVector2 &end, const FRay &ray, FRaycastHit &hit);
+bool rayCastPolygon(const FVector2 *vertices, size_t count, const FRay &ray, FRaycastHit &hit);
+
 NS_FXP_END
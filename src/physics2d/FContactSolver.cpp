@@ -0,0 +1,647 @@
+﻿//////////////////////////////////////////////////////////////////////
+/// Desc  FContactSolver
+/// Time  2026/10/18
+/// Author youlanhai
+//////////////////////////////////////////////////////////////////////
+
+#include "FContactSolver.hpp"
+#include "FRigidbody.hpp"
+#include "FCollider.hpp"
+#include "math/FMath.hpp"
+#include "common/FThreadPool.hpp"
+
+#include <atomic>
+
+#if !defined(FXP_DISABLE_SIMD) && (defined(__SSE4_1__) || defined(__AVX__))
+#   define FXP_SOLVER_SIMD 1
+#   include <smmintrin.h>
+#endif
+
+NS_FXP_BEGIN
+
+/** 并行求解时，每个线程一次领取的组数量 */
+static const size_t SOLVER_GROUP_BATCH = 4;
+
+/** 与doPostSeperation一致，限制一个最大的力，避免越界 */
+static const int MAX_FORCE = FFloat(1000).value;
+
+/////////////////////////////////////////////////////////////////////
+// 标量运算。与Fixed32和FVector3的运算顺序保持一致
+/////////////////////////////////////////////////////////////////////
+
+static inline int fixedMul(int a, int b)
+{
+    return Fixed32::down32(int64_t(a) * b);
+}
+
+static inline int fixedDot(int ax, int az, int bx, int bz)
+{
+    return (int)Fixed32::down(int64_t(ax) * bx + int64_t(az) * bz);
+}
+
+/** 等价于FVector3::crossXZ */
+static inline int fixedCross(int ax, int az, int bx, int bz)
+{
+    return (int)Fixed32::down(int64_t(ax) * bz - int64_t(az) * bx);
+}
+
+static inline int fixedClamp(int a, int low, int high)
+{
+    return a > low ? (a < high ? a : high) : low;
+}
+
+static inline int fixedAbs(int a)
+{
+    return a < 0 ? -a : a;
+}
+
+static inline int fixedMax(int a, int b)
+{
+    return a > b ? a : b;
+}
+
+/** 点绕刚体旋转产生的速度分量。等价于FRigidbody::getPointVelocity */
+static inline int fixedAngular(int r, int angleVelocity)
+{
+    return fixedMul(fixedMul(r, angleVelocity), FMath::DEGREE_RADIAN.value);
+}
+
+/** 等价于FRigidbody::applyImpulse和FRigidbody::applyTorqueImpulse */
+static inline void fixedApply(int &vx, int &vz, int &w, int rx, int rz, int fx, int fz, int invMass, int invInertia)
+{
+    vx += fixedMul(fx, invMass);
+    vz += fixedMul(fz, invMass);
+    w += fixedMul(fixedMul(fixedCross(rx, rz, fx, fz), FMath::RADIAN_DEGREE.value), invInertia);
+}
+
+#ifdef FXP_SOLVER_SIMD
+/////////////////////////////////////////////////////////////////////
+// 向量运算。每个函数都与上面对应的标量运算结果一致
+/////////////////////////////////////////////////////////////////////
+
+static inline __m128i simdLoad(const int *p)
+{
+    return _mm_loadu_si128((const __m128i*)p);
+}
+
+static inline void simdStore(int *p, __m128i v)
+{
+    _mm_storeu_si128((__m128i*)p, v);
+}
+
+static inline __m128i simdGather(const int *data, const int *index)
+{
+    return _mm_set_epi32(data[index[3]], data[index[2]], data[index[1]], data[index[0]]);
+}
+
+/** 取每个64位乘积右移SHIFT后的低32位，与int64截断成int的结果一致 */
+static inline __m128i simdDown(__m128i even, __m128i odd)
+{
+    even = _mm_srli_epi64(even, Fixed32::SHIFT);
+    odd = _mm_slli_epi64(_mm_srli_epi64(odd, Fixed32::SHIFT), 32);
+    return _mm_blend_epi16(even, odd, 0xCC);
+}
+
+static inline __m128i simdOdd(__m128i v)
+{
+    return _mm_srli_epi64(v, 32);
+}
+
+static inline __m128i simdMul(__m128i a, __m128i b)
+{
+    return simdDown(_mm_mul_epi32(a, b), _mm_mul_epi32(simdOdd(a), simdOdd(b)));
+}
+
+static inline __m128i simdDot(__m128i ax, __m128i az, __m128i bx, __m128i bz)
+{
+    __m128i even = _mm_add_epi64(_mm_mul_epi32(ax, bx), _mm_mul_epi32(az, bz));
+    __m128i odd = _mm_add_epi64(
+        _mm_mul_epi32(simdOdd(ax), simdOdd(bx)),
+        _mm_mul_epi32(simdOdd(az), simdOdd(bz)));
+    return simdDown(even, odd);
+}
+
+static inline __m128i simdCross(__m128i ax, __m128i az, __m128i bx, __m128i bz)
+{
+    __m128i even = _mm_sub_epi64(_mm_mul_epi32(ax, bz), _mm_mul_epi32(az, bx));
+    __m128i odd = _mm_sub_epi64(
+        _mm_mul_epi32(simdOdd(ax), simdOdd(bz)),
+        _mm_mul_epi32(simdOdd(az), simdOdd(bx)));
+    return simdDown(even, odd);
+}
+
+static inline __m128i simdClamp(__m128i a, __m128i low, __m128i high)
+{
+    __m128i mask = _mm_cmpgt_epi32(a, low);
+    return _mm_blendv_epi8(low, _mm_min_epi32(a, high), mask);
+}
+
+/** 4个车道中的最大值 */
+static inline int simdHorizontalMax(__m128i v)
+{
+    v = _mm_max_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_max_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(v);
+}
+
+static inline __m128i simdNeg(__m128i v)
+{
+    return _mm_sub_epi32(_mm_setzero_si128(), v);
+}
+
+static inline __m128i simdAngular(__m128i r, __m128i angleVelocity)
+{
+    return simdMul(simdMul(r, angleVelocity), _mm_set1_epi32(FMath::DEGREE_RADIAN.value));
+}
+
+static inline void simdApply(__m128i &vx, __m128i &vz, __m128i &w, __m128i rx, __m128i rz,
+    __m128i fx, __m128i fz, __m128i invMass, __m128i invInertia)
+{
+    vx = _mm_add_epi32(vx, simdMul(fx, invMass));
+    vz = _mm_add_epi32(vz, simdMul(fz, invMass));
+    __m128i torque = simdMul(simdCross(rx, rz, fx, fz), _mm_set1_epi32(FMath::RADIAN_DEGREE.value));
+    w = _mm_add_epi32(w, simdMul(torque, invInertia));
+}
+#endif
+
+/////////////////////////////////////////////////////////////////////
+// FContactSolver
+/////////////////////////////////////////////////////////////////////
+
+FContactSolver::FContactSolver()
+{
+}
+
+FContactSolver::~FContactSolver()
+{
+    clear();
+}
+
+bool FContactSolver::isSimdSupported()
+{
+#ifdef FXP_SOLVER_SIMD
+    return true;
+#else
+    return false;
+#endif
+}
+
+void FContactSolver::clear()
+{
+    for (FRigidbody *body : bodies_)
+    {
+        if (body != nullptr)
+        {
+            body->solverIndex_ = -1;
+        }
+    }
+
+    bodies_.clear();
+    velocityX_.clear();
+    velocityZ_.clear();
+    angleVelocity_.clear();
+    invMass_.clear();
+    invInertia_.clear();
+    writable_.clear();
+
+    points_.clear();
+    active_.clear();
+    bodyA_.clear();
+    bodyB_.clear();
+    radiusAX_.clear();
+    radiusAZ_.clear();
+    radiusBX_.clear();
+    radiusBZ_.clear();
+    normalX_.clear();
+    normalZ_.clear();
+    bias_.clear();
+    massNormal_.clear();
+    massTangent_.clear();
+    fraction_.clear();
+    forceNormal_.clear();
+    forceTangent_.clear();
+
+    groupOffsets_.clear();
+    colorCount_ = 0;
+}
+
+void FContactSolver::build(FColliderPair *const *pairs, const size_t *colorOffsets, int colorCount)
+{
+    clear();
+    colorCount_ = colorCount;
+
+    // 占位刚体。所有数据都是0，不会被写入
+    bodies_.push_back(nullptr);
+    velocityX_.push_back(0);
+    velocityZ_.push_back(0);
+    angleVelocity_.push_back(0);
+    invMass_.push_back(0);
+    invInertia_.push_back(0);
+    writable_.push_back(0);
+
+    // 可以并行的颜色，每LANE_COUNT个碰撞对一组；最后一种颜色每个碰撞对单独一组
+    groupOffsets_.resize(colorCount + 2);
+    size_t groupCount = 0;
+    for (int color = 0; color <= colorCount; ++color)
+    {
+        groupOffsets_[color] = groupCount;
+
+        size_t count = colorOffsets[color + 1] - colorOffsets[color];
+        groupCount += color < colorCount ? (count + LANE_COUNT - 1) / LANE_COUNT : count;
+    }
+    groupOffsets_[colorCount + 1] = groupCount;
+
+    size_t rowCount = groupCount * FCollisionInfo::MAX_POINTS * LANE_COUNT;
+    points_.assign(rowCount, nullptr);
+    active_.assign(rowCount, 0);
+    bodyA_.assign(rowCount, 0);
+    bodyB_.assign(rowCount, 0);
+    radiusAX_.assign(rowCount, 0);
+    radiusAZ_.assign(rowCount, 0);
+    radiusBX_.assign(rowCount, 0);
+    radiusBZ_.assign(rowCount, 0);
+    normalX_.assign(rowCount, 0);
+    normalZ_.assign(rowCount, 0);
+    bias_.assign(rowCount, 0);
+    massNormal_.assign(rowCount, 0);
+    massTangent_.assign(rowCount, 0);
+    fraction_.assign(rowCount, 0);
+    forceNormal_.assign(rowCount, 0);
+    forceTangent_.assign(rowCount, 0);
+
+    for (int color = 0; color <= colorCount; ++color)
+    {
+        size_t lanes = color < colorCount ? LANE_COUNT : 1;
+        size_t group = groupOffsets_[color];
+        for (size_t i = colorOffsets[color]; i < colorOffsets[color + 1]; ++i)
+        {
+            size_t k = i - colorOffsets[color];
+            addPair(pairs[i], group + k / lanes, (int)(k % lanes));
+        }
+    }
+}
+
+int FContactSolver::addBody(FRigidbody *body)
+{
+    if (body->solverIndex_ >= 0)
+    {
+        return body->solverIndex_;
+    }
+
+    int index = (int)bodies_.size();
+    body->solverIndex_ = index;
+    bodies_.push_back(body);
+
+    velocityX_.push_back(body->velocity.x.value);
+    velocityZ_.push_back(body->velocity.z.value);
+    angleVelocity_.push_back(body->angleVelocity.value);
+
+    // 静态刚体不受冲量影响，质量的倒数当作0处理
+    bool writable = !body->isStatic();
+    invMass_.push_back(writable ? body->invMass.value : 0);
+    invInertia_.push_back(writable ? body->invInertia.value : 0);
+    writable_.push_back(writable ? 1 : 0);
+    return index;
+}
+
+void FContactSolver::addPair(FColliderPair *pair, size_t group, int lane)
+{
+    FRigidbody *a = pair->a->getRigidbody();
+    FRigidbody *b = pair->b->getRigidbody();
+    int indexA = addBody(a);
+    int indexB = addBody(b);
+
+    FCollisionInfo &info = pair->collisionInfo;
+    FFloat fraction = FFloat(1) - (info.a->getFriction() + info.a->getFriction()) / 2;
+
+    for (int k = 0; k < info.pointCount; ++k)
+    {
+        size_t row = (group * FCollisionInfo::MAX_POINTS + k) * LANE_COUNT + lane;
+        FContactPoint &cp = info.points[k];
+
+        points_[row] = &cp;
+        active_[row] = 1;
+        bodyA_[row] = indexA;
+        bodyB_[row] = indexB;
+        radiusAX_[row] = (cp.pointA.x - a->position.x).value;
+        radiusAZ_[row] = (cp.pointA.z - a->position.z).value;
+        radiusBX_[row] = (cp.pointB.x - b->position.x).value;
+        radiusBZ_[row] = (cp.pointB.z - b->position.z).value;
+        normalX_[row] = info.normal.x.value;
+        normalZ_[row] = info.normal.z.value;
+        bias_[row] = cp.bias.value;
+        massNormal_[row] = cp.massNormal.value;
+        massTangent_[row] = cp.massTangent.value;
+        fraction_[row] = fraction.value;
+        forceNormal_[row] = cp.forceNormal.value;
+        forceTangent_[row] = cp.forceTangent.value;
+    }
+}
+
+int FContactSolver::solve(int minIterations, int maxIterations, FFloat tolerance, FThreadPool *threadPool)
+{
+    int iteration = 0;
+    while (iteration < maxIterations)
+    {
+        // 取最大值与执行顺序无关，多线程下结果也是确定的
+        std::atomic<int> sharedDelta(0);
+        int maxDelta = 0;
+
+        for (int color = 0; color < colorCount_; ++color)
+        {
+            size_t begin = groupOffsets_[color];
+            size_t end = groupOffsets_[color + 1];
+
+            if (threadPool != nullptr)
+            {
+                threadPool->parallelFor(end - begin, SOLVER_GROUP_BATCH, [this, begin, &sharedDelta](size_t first, size_t last)
+                {
+                    int delta = 0;
+                    for (size_t group = begin + first; group < begin + last; ++group)
+                    {
+                        delta = fixedMax(delta, solveGroup(group));
+                    }
+
+                    int current = sharedDelta.load();
+                    while (delta > current && !sharedDelta.compare_exchange_weak(current, delta))
+                    {
+                    }
+                });
+            }
+            else
+            {
+                for (size_t group = begin; group < end; ++group)
+                {
+                    maxDelta = fixedMax(maxDelta, solveGroup(group));
+                }
+            }
+        }
+
+        // 颜色不够用的碰撞对之间可能共享刚体，只能串行
+        for (size_t group = groupOffsets_[colorCount_]; group < groupOffsets_[colorCount_ + 1]; ++group)
+        {
+            maxDelta = fixedMax(maxDelta, solveGroup(group));
+        }
+
+        ++iteration;
+        maxDelta = fixedMax(maxDelta, sharedDelta.load());
+        if (iteration >= minIterations && maxDelta <= tolerance.value)
+        {
+            break;
+        }
+    }
+    return iteration;
+}
+
+void FContactSolver::writeBack()
+{
+    for (size_t i = 1; i < bodies_.size(); ++i)
+    {
+        if (writable_[i])
+        {
+            FRigidbody *body = bodies_[i];
+            body->velocity.x.value = velocityX_[i];
+            body->velocity.z.value = velocityZ_[i];
+            body->angleVelocity.value = angleVelocity_[i];
+        }
+    }
+
+    for (size_t row = 0; row < points_.size(); ++row)
+    {
+        if (points_[row] != nullptr)
+        {
+            points_[row]->forceNormal.value = forceNormal_[row];
+            points_[row]->forceTangent.value = forceTangent_[row];
+        }
+    }
+
+    clear();
+}
+
+int FContactSolver::solveGroup(size_t group)
+{
+    int maxDelta = 0;
+    for (int k = 0; k < FCollisionInfo::MAX_POINTS; ++k)
+    {
+        size_t row = (group * FCollisionInfo::MAX_POINTS + k) * LANE_COUNT;
+
+        bool any = false;
+        for (int i = 0; i < LANE_COUNT; ++i)
+        {
+            any |= active_[row + i] != 0;
+        }
+
+        if (any)
+        {
+#ifdef FXP_SOLVER_SIMD
+            maxDelta = fixedMax(maxDelta, simdEnabled_ ? solveLanes(row) : solveRows(row));
+#else
+            maxDelta = fixedMax(maxDelta, solveRows(row));
+#endif
+        }
+    }
+    return maxDelta;
+}
+
+int FContactSolver::solveRow(size_t row)
+{
+    if (!active_[row])
+    {
+        return 0;
+    }
+
+    int a = bodyA_[row];
+    int b = bodyB_[row];
+
+    int vax = velocityX_[a], vaz = velocityZ_[a], wa = angleVelocity_[a];
+    int vbx = velocityX_[b], vbz = velocityZ_[b], wb = angleVelocity_[b];
+
+    int rax = radiusAX_[row], raz = radiusAZ_[row];
+    int rbx = radiusBX_[row], rbz = radiusBZ_[row];
+    int nx = normalX_[row], nz = normalZ_[row];
+
+    // 计算分离力
+    int rvx = (vax + fixedAngular(-raz, wa)) - (vbx + fixedAngular(-rbz, wb));
+    int rvz = (vaz + fixedAngular(rax, wa)) - (vbz + fixedAngular(rbx, wb));
+
+    int vn = fixedDot(rvx, rvz, nx, nz);
+    int dFn = fixedMul(vn + bias_[row], massNormal_[row]);
+    int oldFn = forceNormal_[row];
+    int fn = fixedClamp(oldFn + dFn, 0, MAX_FORCE);
+    forceNormal_[row] = fn;
+    dFn = fn - oldFn;
+
+    int fx = fixedMul(nx, dFn);
+    int fz = fixedMul(nz, dFn);
+    fixedApply(vax, vaz, wa, rax, raz, -fx, -fz, invMass_[a], invInertia_[a]);
+    fixedApply(vbx, vbz, wb, rbx, rbz, fx, fz, invMass_[b], invInertia_[b]);
+
+    // 计算摩擦力
+    int tx = -nz, tz = nx;
+    rvx = (vax + fixedAngular(-raz, wa)) - (vbx + fixedAngular(-rbz, wb));
+    rvz = (vaz + fixedAngular(rax, wa)) - (vbz + fixedAngular(rbx, wb));
+
+    int vt = fixedDot(rvx, rvz, tx, tz);
+    int dFt = fixedMul(vt, massTangent_[row]);
+    int maxFt = fixedMul(fraction_[row], fn);
+    int oldFt = forceTangent_[row];
+    int ft = fixedClamp(oldFt + dFt, -maxFt, maxFt);
+    forceTangent_[row] = ft;
+    dFt = ft - oldFt;
+
+    int maxDelta = fixedMax(fixedAbs(dFn), fixedAbs(dFt));
+
+    fx = fixedMul(tx, dFt);
+    fz = fixedMul(tz, dFt);
+    fixedApply(vax, vaz, wa, rax, raz, -fx, -fz, invMass_[a], invInertia_[a]);
+    fixedApply(vbx, vbz, wb, rbx, rbz, fx, fz, invMass_[b], invInertia_[b]);
+
+    if (writable_[a])
+    {
+        velocityX_[a] = vax;
+        velocityZ_[a] = vaz;
+        angleVelocity_[a] = wa;
+    }
+    if (writable_[b])
+    {
+        velocityX_[b] = vbx;
+        velocityZ_[b] = vbz;
+        angleVelocity_[b] = wb;
+    }
+    return maxDelta;
+}
+
+#ifdef FXP_SOLVER_SIMD
+
+int FContactSolver::solveLanes(size_t row)
+{
+    const int *indexA = bodyA_.data() + row;
+    const int *indexB = bodyB_.data() + row;
+
+    __m128i vax = simdGather(velocityX_.data(), indexA);
+    __m128i vaz = simdGather(velocityZ_.data(), indexA);
+    __m128i wa = simdGather(angleVelocity_.data(), indexA);
+    __m128i invMassA = simdGather(invMass_.data(), indexA);
+    __m128i invInertiaA = simdGather(invInertia_.data(), indexA);
+
+    __m128i vbx = simdGather(velocityX_.data(), indexB);
+    __m128i vbz = simdGather(velocityZ_.data(), indexB);
+    __m128i wb = simdGather(angleVelocity_.data(), indexB);
+    __m128i invMassB = simdGather(invMass_.data(), indexB);
+    __m128i invInertiaB = simdGather(invInertia_.data(), indexB);
+
+    __m128i rax = simdLoad(radiusAX_.data() + row);
+    __m128i raz = simdLoad(radiusAZ_.data() + row);
+    __m128i rbx = simdLoad(radiusBX_.data() + row);
+    __m128i rbz = simdLoad(radiusBZ_.data() + row);
+    __m128i nx = simdLoad(normalX_.data() + row);
+    __m128i nz = simdLoad(normalZ_.data() + row);
+    __m128i negRaz = simdNeg(raz);
+    __m128i negRbz = simdNeg(rbz);
+
+    // 计算分离力。未使用的车道数据都是0，计算结果不变
+    __m128i rvx = _mm_sub_epi32(_mm_add_epi32(vax, simdAngular(negRaz, wa)), _mm_add_epi32(vbx, simdAngular(negRbz, wb)));
+    __m128i rvz = _mm_sub_epi32(_mm_add_epi32(vaz, simdAngular(rax, wa)), _mm_add_epi32(vbz, simdAngular(rbx, wb)));
+
+    __m128i vn = simdDot(rvx, rvz, nx, nz);
+    __m128i dFn = simdMul(_mm_add_epi32(vn, simdLoad(bias_.data() + row)), simdLoad(massNormal_.data() + row));
+    __m128i oldFn = simdLoad(forceNormal_.data() + row);
+    __m128i fn = simdClamp(_mm_add_epi32(oldFn, dFn), _mm_setzero_si128(), _mm_set1_epi32(MAX_FORCE));
+    simdStore(forceNormal_.data() + row, fn);
+    dFn = _mm_sub_epi32(fn, oldFn);
+
+    __m128i fx = simdMul(nx, dFn);
+    __m128i fz = simdMul(nz, dFn);
+    simdApply(vax, vaz, wa, rax, raz, simdNeg(fx), simdNeg(fz), invMassA, invInertiaA);
+    simdApply(vbx, vbz, wb, rbx, rbz, fx, fz, invMassB, invInertiaB);
+
+    // 计算摩擦力
+    __m128i tx = simdNeg(nz);
+    __m128i tz = nx;
+    rvx = _mm_sub_epi32(_mm_add_epi32(vax, simdAngular(negRaz, wa)), _mm_add_epi32(vbx, simdAngular(negRbz, wb)));
+    rvz = _mm_sub_epi32(_mm_add_epi32(vaz, simdAngular(rax, wa)), _mm_add_epi32(vbz, simdAngular(rbx, wb)));
+
+    __m128i vt = simdDot(rvx, rvz, tx, tz);
+    __m128i dFt = simdMul(vt, simdLoad(massTangent_.data() + row));
+    __m128i maxFt = simdMul(simdLoad(fraction_.data() + row), fn);
+    __m128i oldFt = simdLoad(forceTangent_.data() + row);
+    __m128i ft = simdClamp(_mm_add_epi32(oldFt, dFt), simdNeg(maxFt), maxFt);
+    simdStore(forceTangent_.data() + row, ft);
+    dFt = _mm_sub_epi32(ft, oldFt);
+
+    // 未使用的车道冲量变化是0，不影响最大值
+    int maxDelta = simdHorizontalMax(_mm_max_epi32(_mm_abs_epi32(dFn), _mm_abs_epi32(dFt)));
+
+    fx = simdMul(tx, dFt);
+    fz = simdMul(tz, dFt);
+    simdApply(vax, vaz, wa, rax, raz, simdNeg(fx), simdNeg(fz), invMassA, invInertiaA);
+    simdApply(vbx, vbz, wb, rbx, rbz, fx, fz, invMassB, invInertiaB);
+
+    // 写回刚体速度。组内的动态刚体互不相同，静态刚体和占位刚体不写入
+    int outAX[LANE_COUNT], outAZ[LANE_COUNT], outAW[LANE_COUNT];
+    int outBX[LANE_COUNT], outBZ[LANE_COUNT], outBW[LANE_COUNT];
+    simdStore(outAX, vax);
+    simdStore(outAZ, vaz);
+    simdStore(outAW, wa);
+    simdStore(outBX, vbx);
+    simdStore(outBZ, vbz);
+    simdStore(outBW, wb);
+
+    for (int i = 0; i < LANE_COUNT; ++i)
+    {
+        if (!active_[row + i])
+        {
+            continue;
+        }
+
+        int a = indexA[i];
+        if (writable_[a])
+        {
+            velocityX_[a] = outAX[i];
+            velocityZ_[a] = outAZ[i];
+            angleVelocity_[a] = outAW[i];
+        }
+
+        int b = indexB[i];
+        if (writable_[b])
+        {
+            velocityX_[b] = outBX[i];
+            velocityZ_[b] = outBZ[i];
+            angleVelocity_[b] = outBW[i];
+        }
+    }
+    return maxDelta;
+}
+
+#endif
+
+int FContactSolver::solveRows(size_t row)
+{
+    int maxDelta = 0;
+    for (int i = 0; i < LANE_COUNT; ++i)
+    {
+        maxDelta = fixedMax(maxDelta, solveRow(row + i));
+    }
+    return maxDelta;
+}
+
+size_t FContactSolver::getMemorySize() const
+{
+    size_t intArrays = velocityX_.capacity() + velocityZ_.capacity() + angleVelocity_.capacity() +
+        invMass_.capacity() + invInertia_.capacity() +
+        bodyA_.capacity() + bodyB_.capacity() +
+        radiusAX_.capacity() + radiusAZ_.capacity() + radiusBX_.capacity() + radiusBZ_.capacity() +
+        normalX_.capacity() + normalZ_.capacity() + bias_.capacity() +
+        massNormal_.capacity() + massTangent_.capacity() + fraction_.capacity() +
+        forceNormal_.capacity() + forceTangent_.capacity();
+
+    return sizeof(*this) +
+        intArrays * sizeof(int) +
+        bodies_.capacity() * sizeof(FRigidbody*) +
+        points_.capacity() * sizeof(FContactPoint*) +
+        writable_.capacity() +
+        active_.capacity() +
+        groupOffsets_.capacity() * sizeof(size_t);
+}
+
+NS_FXP_END
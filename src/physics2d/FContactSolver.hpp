@@ -0,0 +1,110 @@
+﻿//////////////////////////////////////////////////////////////////////
+/// Desc  FContactSolver
+/// Time  2026/10/18
+/// Author youlanhai
+//////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "FPhysicsDef.hpp"
+#include <vector>
+
+NS_FXP_BEGIN
+
+class FThreadPool;
+
+/** 接触约束的迭代求解器。
+ *  把参与求解的刚体速度和接触点数据拷贝到紧凑的数组中(SoA)，迭代完成后再一次性写回。
+ *  同一颜色的碰撞对以LANE_COUNT个为一组，组内的碰撞对没有共享的动态刚体，
+ *  开启SSE4.1时一组使用一次向量运算求解。全部是定点数的整数运算，向量版本与标量版本的结果完全一致。
+ */
+class FXP_API FContactSolver
+{
+public:
+    /** 每组碰撞对的数量 */
+    static const int LANE_COUNT = 4;
+
+    FContactSolver();
+    ~FContactSolver();
+
+    /** 清空数据 */
+    void clear();
+
+    /** 拷贝刚体和接触点数据。必须在doPreSeperation之后调用。
+     *  @param pairs        按颜色分组的碰撞对
+     *  @param colorOffsets 每种颜色在pairs中的起始位置，共colorCount + 2个元素
+     *  @param colorCount   可以并行求解的颜色数量。之后的一组碰撞对会串行求解
+     */
+    void build(FColliderPair *const *pairs, const size_t *colorOffsets, int colorCount);
+
+    /** 迭代求解。threadPool为空时在当前线程求解
+     *  @param minIterations    最少迭代次数
+     *  @param maxIterations    最多迭代次数
+     *  @param tolerance        一轮迭代中冲量变化的最大值不超过tolerance时，提前结束迭代
+     *  @return 实际的迭代次数
+     */
+    int solve(int minIterations, int maxIterations, FFloat tolerance, FThreadPool *threadPool);
+
+    /** 把速度和累积冲量写回刚体与接触点，然后清空数据 */
+    void writeBack();
+
+    /** 编译时是否开启了SSE4.1 */
+    static bool isSimdSupported();
+
+    /** 是否使用向量运算求解，默认开启。关闭后逐行标量求解，用于验证两者的结果一致 */
+    void setSimdEnabled(bool enable) { simdEnabled_ = enable; }
+    bool isSimdEnabled() const { return simdEnabled_ && isSimdSupported(); }
+
+    size_t getMemorySize() const;
+
+private:
+    int addBody(FRigidbody *body);
+    void addPair(FColliderPair *pair, size_t group, int lane);
+
+    /** 求解一组碰撞对。以下几个函数都返回冲量变化的最大绝对值 */
+    int solveGroup(size_t group);
+
+    /** 标量求解一行接触点 */
+    int solveRow(size_t row);
+
+    /** 向量求解LANE_COUNT行接触点 */
+    int solveLanes(size_t row);
+
+    /** 逐行标量求解LANE_COUNT行接触点 */
+    int solveRows(size_t row);
+
+    /** 刚体数据。0号是占位刚体，用于填充不满的组 */
+    std::vector<FRigidbody*>    bodies_;
+    std::vector<int>            velocityX_;
+    std::vector<int>            velocityZ_;
+    std::vector<int>            angleVelocity_;
+    std::vector<int>            invMass_;
+    std::vector<int>            invInertia_;
+    /** 静态刚体不会被修改，也不允许写入，避免多个线程同时写 */
+    std::vector<uint8_t>        writable_;
+
+    /** 接触点数据。第g组第k个接触点的第i个碰撞对，行号为 (g * MAX_POINTS + k) * LANE_COUNT + i */
+    std::vector<FContactPoint*> points_;
+    std::vector<uint8_t>        active_;
+    std::vector<int>            bodyA_;
+    std::vector<int>            bodyB_;
+    std::vector<int>            radiusAX_;
+    std::vector<int>            radiusAZ_;
+    std::vector<int>            radiusBX_;
+    std::vector<int>            radiusBZ_;
+    std::vector<int>            normalX_;
+    std::vector<int>            normalZ_;
+    std::vector<int>            bias_;
+    std::vector<int>            massNormal_;
+    std::vector<int>            massTangent_;
+    std::vector<int>            fraction_;
+    std::vector<int>            forceNormal_;
+    std::vector<int>            forceTangent_;
+
+    /** 每种颜色的起始组 */
+    std::vector<size_t>         groupOffsets_;
+    int                         colorCount_ = 0;
+    bool                        simdEnabled_ = true;
+};
+
+NS_FXP_END
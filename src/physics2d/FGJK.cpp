@@ -100,10 +100,10 @@ inline bool containsPoint(const std::vector<FVector2> &points, const FVector2 &p
     return containsPoint(points.data(), points.size(), point);
 }
 
-inline SupportPoint supportPoint(FCollider *shapeA, FCollider *shapeB, const FVector2 &dir)
+inline SupportPoint supportPoint(FCollider *shapeA, FCollider *shapeB, const FVector2 &dir, int &hintA, int &hintB)
 {
-    FVector2 a = shapeA->getFarthestPointInDirection(dir);
-    FVector2 b = shapeB->getFarthestPointInDirection(-dir);
+    FVector2 a = shapeA->getFarthestPointWithHint(dir, hintA);
+    FVector2 b = shapeB->getFarthestPointWithHint(-dir, hintB);
     return SupportPoint
     {
         a - b,
@@ -288,10 +288,70 @@ FGJK::FGJK()
     simplexEdge = new SimplexEdge();
 }
 
-bool FGJK::queryCollision(FCollider* shapeA, FCollider* shapeB)
+FGJK::~FGJK()
+{
+    delete simplex;
+    delete simplexEdge;
+}
+
+bool FGJK::queryCollision(FCollider* shapeA, FCollider* shapeB, int hintA, int hintB)
+{
+    reset(shapeA, shapeB, hintA, hintB);
+
+    LS_PROFILER_BEGIN(PK_PHYSICS_GJK_ONLY);
+    queryGJK();
+    LS_PROFILER_END(PK_PHYSICS_GJK_ONLY);
+
+    if (!isCollision)
+    {
+        computeClosetPoint(simplex->getSupport(0), simplex->getSupport(1));
+    }
+    else
+    {
+        LS_PROFILER_BEGIN(PK_PHYSICS_EPA_ONLY);
+        queryEPA();
+        LS_PROFILER_END(PK_PHYSICS_EPA_ONLY);
+    }
+
+    return isCollision;
+}
+
+bool FGJK::queryOverlap(FCollider* shapeA, FCollider* shapeB, int hintA, int hintB)
+{
+    reset(shapeA, shapeB, hintA, hintB);
+
+    LS_PROFILER_BEGIN(PK_PHYSICS_GJK_ONLY);
+    queryGJK();
+    LS_PROFILER_END(PK_PHYSICS_GJK_ONLY);
+
+    return isCollision;
+}
+
+bool FGJK::queryDistance(FCollider* shapeA, const FVector2 &offsetA, FCollider* shapeB)
+{
+    reset(shapeA, shapeB, -1, -1);
+    this->offsetA = offsetA;
+
+    LS_PROFILER_BEGIN(PK_PHYSICS_GJK_ONLY);
+    queryGJK();
+    LS_PROFILER_END(PK_PHYSICS_GJK_ONLY);
+
+    if (!isCollision)
+    {
+        computeClosetPoint(simplex->getSupport(0), simplex->getSupport(1));
+    }
+
+    this->offsetA = FVector2::ZERO;
+    return !isCollision;
+}
+
+void FGJK::reset(FCollider* shapeA, FCollider* shapeB, int hintA, int hintB)
 {
     this->shapeA = shapeA;
     this->shapeB = shapeB;
+    offsetA = FVector2::ZERO;
+    supportIndexA = hintA;
+    supportIndexB = hintB;
 
     simplex->clear();
     isCollision = false;
@@ -303,9 +363,10 @@ bool FGJK::queryCollision(FCollider* shapeA, FCollider* shapeB)
     simplexEdge->clear();
     penetrationNormal = FVector2::ZERO;
     penetrationDistance = FFloat(0);
+}
 
-    LS_PROFILER_BEGIN(PK_PHYSICS_GJK_ONLY);
-
+void FGJK::queryGJK()
+{
     direction = findFirstDirection();
     simplex->add(support(direction));
     simplex->add(support(-direction));
@@ -340,21 +401,6 @@ bool FGJK::queryCollision(FCollider* shapeA, FCollider* shapeB)
 
         direction = findNextDirection();
     }
-
-    LS_PROFILER_END(PK_PHYSICS_GJK_ONLY);
-
-    if (!isCollision)
-    {
-        computeClosetPoint(simplex->getSupport(0), simplex->getSupport(1));
-    }
-    else
-    {
-        LS_PROFILER_BEGIN(PK_PHYSICS_EPA_ONLY);
-        queryEPA();
-        LS_PROFILER_END(PK_PHYSICS_EPA_ONLY);
-    }
-
-    return isCollision;
 }
 
 void FGJK::queryEPA()
@@ -377,7 +423,7 @@ void FGJK::queryEPA()
         penetrationNormal = e->normal;
         penetrationDistance = e->distance;
 
-        SupportPoint sp = supportPoint(shapeA, shapeB, e->normal);
+        SupportPoint sp = support(e->normal);
         FFloat distance = sp.point.dot(e->normal);
         if (distance - e->distance < epsilon)
         {
@@ -398,18 +444,21 @@ void FGJK::queryEPA()
 
 SupportPoint FGJK::support(const FVector2 &dir)
 {
-    return supportPoint(shapeA, shapeB, dir);
+    SupportPoint p = supportPoint(shapeA, shapeB, dir, supportIndexA, supportIndexB);
+    p.point += offsetA;
+    p.fromA += offsetA;
+    return p;
 }
 
 FVector2 FGJK::findFirstDirection()
 {
-    FVector2 pointA = shapeA->getBounds().getCenter();
+    FVector2 pointA = shapeA->getBounds().getCenter() + offsetA;
     FVector2 pointB = shapeB->getBounds().getCenter();
 
     FVector2 dir = pointA - pointB;
     if (dir.lengthSq() < epsilon) // 避免首次取到的点距离为0
     {
-        dir = shapeA->getFirstVertex() - pointB;
+        dir = shapeA->getFirstVertex() + offsetA - pointB;
     }
     return dir;
 }
@@ -39,6 +39,9 @@ private:
     /// 当前support使用的方向
     FVector2 direction;
 
+    /// shapeA的平移量。用于在不修改collider的情况下，查询平移后的位置
+    FVector2 offsetA;
+
 public:
     bool isCollision = false;
     // 最近点
@@ -48,12 +51,33 @@ public:
     FVector2 penetrationNormal;
     FFloat penetrationDistance;
 
+    /// 最后一次support查询在A、B上的顶点索引。可作为下次查询的起点
+    int supportIndexA = -1;
+    int supportIndexB = -1;
+
     FGJK();
+    ~FGJK();
+
+    /** 查询两个形状是否相交。
+     *  @param hintA,hintB  上次查询得到的support顶点索引，用于多边形的爬山查找。小于0表示没有提示。
+     */
+    bool queryCollision(FCollider* shapeA, FCollider* shapeB, int hintA = -1, int hintB = -1);
+
+    /** 仅判断两个形状是否相交。单形体包含原点后立即返回，不计算穿透向量和最近点。*/
+    bool queryOverlap(FCollider* shapeA, FCollider* shapeB, int hintA = -1, int hintB = -1);
+
+    /** 查询shapeA平移offsetA之后，与shapeB的最近点。
+     *  @return 两个形状不相交时返回true，最近点保存在closestOnA和closestOnB中；相交时返回false。
+     */
+    bool queryDistance(FCollider* shapeA, const FVector2 &offsetA, FCollider* shapeB);
 
-    bool queryCollision(FCollider* shapeA, FCollider* shapeB);
     size_t getMemorySize();
 
 private:
+    void reset(FCollider* shapeA, FCollider* shapeB, int hintA, int hintB);
+
+    void queryGJK();
+
     SupportPoint support(const FVector2 &dir);
 
     FVector2 findFirstDirection();
@@ -0,0 +1,184 @@
+﻿//////////////////////////////////////////////////////////////////////
+/// Desc  FInterestQuery
+/// Time  2026/10/18
+/// Author youlanhai
+//////////////////////////////////////////////////////////////////////
+
+#include "FInterestQuery.hpp"
+#include "FPhysics2D.hpp"
+#include "FBVHTree.hpp"
+#include "FCollider.hpp"
+#include "FRigidbody.hpp"
+#include "debug/Profiler.hpp"
+
+#include <algorithm>
+
+NS_FXP_BEGIN
+
+/** 记录与观察者相交的碰撞体所属的刚体。同一刚体可能有多个碰撞体，之后再去重 */
+class QueryInterestBodies
+{
+public:
+    const FVector2 *centers;
+    const FFloat *radii;
+    const FColliderFilter &filter;
+    std::vector<uint32_t> *results;
+
+    QueryInterestBodies(const FVector2 *_centers, const FFloat *_radii, const FColliderFilter &_filter, std::vector<uint32_t> *_results)
+        : centers(_centers)
+        , radii(_radii)
+        , filter(_filter)
+        , results(_results)
+    {
+    }
+
+    void operator()(FBVHNode *node, int i)
+    {
+        FCollider *collider = node->collider.get();
+        if (filter.canCollide(collider->getFilter()) &&
+            collider->getBounds().getDistanceToPoint(centers[i]) <= radii[i])
+        {
+            results[i].push_back(collider->getRigidbody()->getID());
+        }
+    }
+};
+
+FInterestQuery::FInterestQuery(FPhysics2D *physics)
+    : physics_(physics)
+    , packetBodies_(FBVHTree::RAY_PACKET_SIZE)
+{
+    clear();
+}
+
+FInterestQuery::~FInterestQuery()
+{
+}
+
+void FInterestQuery::clear()
+{
+    observerIds_.clear();
+    bodies_.clear();
+    enterBodies_.clear();
+    leaveBodies_.clear();
+    prevBodies_.clear();
+    prevIndices_.clear();
+
+    offsets_.assign(1, 0);
+    enterOffsets_.assign(1, 0);
+    leaveOffsets_.assign(1, 0);
+    prevOffsets_.assign(1, 0);
+}
+
+void FInterestQuery::update(const FInterestObserver *observers, size_t count, const FColliderFilter &filter, int flags)
+{
+    LS_PROFILER(PK_PHYSICS_INTEREST);
+
+    // 当前结果变成上一次的结果
+    prevIndices_.clear();
+    for (size_t i = 0; i < observerIds_.size(); ++i)
+    {
+        prevIndices_[observerIds_[i]] = uint32_t(i);
+    }
+    prevOffsets_.swap(offsets_);
+    prevBodies_.swap(bodies_);
+
+    observerIds_.clear();
+    bodies_.clear();
+    enterBodies_.clear();
+    leaveBodies_.clear();
+    offsets_.assign(1, 0);
+    enterOffsets_.assign(1, 0);
+    leaveOffsets_.assign(1, 0);
+
+    FBVHTree *dynamicTree = physics_->getDynamicTree();
+    FBVHTree *staticTree = physics_->getStaticTree();
+
+    FVector2 centers[FBVHTree::RAY_PACKET_SIZE];
+    FFloat radii[FBVHTree::RAY_PACKET_SIZE];
+
+    for (size_t start = 0; start < count; start += FBVHTree::RAY_PACKET_SIZE)
+    {
+        int n = int(std::min(count - start, size_t(FBVHTree::RAY_PACKET_SIZE)));
+        for (int i = 0; i < n; ++i)
+        {
+            centers[i] = observers[start + i].position.toXZ();
+            radii[i] = observers[start + i].radius;
+            packetBodies_[i].clear();
+        }
+
+        QueryInterestBodies query(centers, radii, filter, packetBodies_.data());
+        if (flags & FQ_DYNAMIC)
+        {
+            dynamicTree->queryByCirclePacket(centers, radii, n, query);
+        }
+        if (flags & FQ_STATIC)
+        {
+            staticTree->queryByCirclePacket(centers, radii, n, query);
+        }
+
+        for (int i = 0; i < n; ++i)
+        {
+            std::vector<uint32_t> &packet = packetBodies_[i];
+            std::sort(packet.begin(), packet.end());
+            packet.erase(std::unique(packet.begin(), packet.end()), packet.end());
+
+            observerIds_.push_back(observers[start + i].id);
+            bodies_.insert(bodies_.end(), packet.begin(), packet.end());
+            offsets_.push_back(uint32_t(bodies_.size()));
+
+            diff(observerIds_.size() - 1);
+        }
+    }
+}
+
+void FInterestQuery::diff(size_t i)
+{
+    const uint32_t *cur = bodies_.data() + offsets_[i];
+    const uint32_t *curEnd = bodies_.data() + offsets_[i + 1];
+
+    const uint32_t *prev = nullptr;
+    const uint32_t *prevEnd = nullptr;
+    auto it = prevIndices_.find(observerIds_[i]);
+    if (it != prevIndices_.end())
+    {
+        prev = prevBodies_.data() + prevOffsets_[it->second];
+        prevEnd = prevBodies_.data() + prevOffsets_[it->second + 1];
+    }
+
+    // 两个有序数组的归并
+    while (cur != curEnd || prev != prevEnd)
+    {
+        if (prev == prevEnd || (cur != curEnd && *cur < *prev))
+        {
+            enterBodies_.push_back(*cur++);
+        }
+        else if (cur == curEnd || *prev < *cur)
+        {
+            leaveBodies_.push_back(*prev++);
+        }
+        else
+        {
+            ++cur;
+            ++prev;
+        }
+    }
+
+    enterOffsets_.push_back(uint32_t(enterBodies_.size()));
+    leaveOffsets_.push_back(uint32_t(leaveBodies_.size()));
+}
+
+size_t FInterestQuery::getMemorySize() const
+{
+    size_t size = sizeof(*this);
+    size += (observerIds_.capacity() + offsets_.capacity() + bodies_.capacity()) * sizeof(uint32_t);
+    size += (enterOffsets_.capacity() + enterBodies_.capacity()) * sizeof(uint32_t);
+    size += (leaveOffsets_.capacity() + leaveBodies_.capacity()) * sizeof(uint32_t);
+    size += (prevOffsets_.capacity() + prevBodies_.capacity()) * sizeof(uint32_t);
+    for (const auto &packet : packetBodies_)
+    {
+        size += packet.capacity() * sizeof(uint32_t);
+    }
+    return size;
+}
+
+NS_FXP_END
@@ -0,0 +1,96 @@
+﻿//////////////////////////////////////////////////////////////////////
+/// Desc  FInterestQuery
+/// Time  2026/10/18
+/// Author youlanhai
+//////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "math/FVector2.hpp"
+#include "math/FVector3.hpp"
+#include "FPhysicsDef.hpp"
+
+#include <vector>
+#include <unordered_map>
+
+NS_FXP_BEGIN
+
+class FPhysics2D;
+
+/** 观察者。通常是一个玩家 */
+class FInterestObserver
+{
+public:
+    /** 观察者的唯一id，用来与上一次的结果对比 */
+    uint32_t        id = 0;
+    FVector3        position;
+    /** 关注半径 */
+    FFloat          radius;
+};
+
+/** 兴趣范围查询，用于网络同步。批量计算每个观察者关注范围内的刚体。
+ *  观察者按FBVHTree::RAY_PACKET_SIZE个一组，每组只遍历一次BVH树，关注范围重叠的观察者共享结点的访问。
+ *  位置相近的观察者在数组中相邻时效果更好。
+ *
+ *  结果使用CSR格式保存：第i个观察者的刚体id为 bodies[offsets[i], offsets[i + 1])，按id从小到大排序。
+ *  enter和leave是与上一次update中同id观察者的结果对比得到的差异，格式相同。
+ *  新出现的观察者，所有可见刚体都算作enter；消失的观察者不会产生leave。
+ */
+class FXP_API FInterestQuery
+{
+    DISABLE_COPY_AND_ASSIGN(FInterestQuery);
+public:
+    explicit FInterestQuery(FPhysics2D *physics);
+    ~FInterestQuery();
+
+    /** 计算所有观察者的可见刚体。刚体的任意碰撞体包围盒与观察者的圆相交即可见，包括触发器。
+     *  @param flags    查询范围，默认只查询动态树。@see FQueryFlag
+     */
+    void update(const FInterestObserver *observers, size_t count, const FColliderFilter &filter, int flags = FQ_DYNAMIC);
+
+    /** 清空结果。下一次update时所有可见刚体都算作enter */
+    void clear();
+
+    size_t getNumObservers() const { return observerIds_.size(); }
+
+    /** 可见刚体，大小为getNumObservers() + 1 */
+    const std::vector<uint32_t>& getOffsets() const { return offsets_; }
+    const std::vector<uint32_t>& getBodies() const { return bodies_; }
+
+    /** 本次新进入关注范围的刚体 */
+    const std::vector<uint32_t>& getEnterOffsets() const { return enterOffsets_; }
+    const std::vector<uint32_t>& getEnterBodies() const { return enterBodies_; }
+
+    /** 本次离开关注范围的刚体 */
+    const std::vector<uint32_t>& getLeaveOffsets() const { return leaveOffsets_; }
+    const std::vector<uint32_t>& getLeaveBodies() const { return leaveBodies_; }
+
+    size_t getMemorySize() const;
+
+private:
+    /** 对比第i个观察者与上一次的结果，生成enter和leave */
+    void diff(size_t i);
+
+private:
+    FPhysics2D*             physics_;
+
+    std::vector<uint32_t>   observerIds_;
+    std::vector<uint32_t>   offsets_;
+    std::vector<uint32_t>   bodies_;
+
+    std::vector<uint32_t>   enterOffsets_;
+    std::vector<uint32_t>   enterBodies_;
+    std::vector<uint32_t>   leaveOffsets_;
+    std::vector<uint32_t>   leaveBodies_;
+
+    /** 上一次update的结果 */
+    std::vector<uint32_t>   prevOffsets_;
+    std::vector<uint32_t>   prevBodies_;
+    /** 观察者id到上一次结果中索引的映射 */
+    std::unordered_map<uint32_t, uint32_t> prevIndices_;
+
+    /** 一组观察者的查询缓存 */
+    std::vector<std::vector<uint32_t>> packetBodies_;
+};
+
+NS_FXP_END
@@ -0,0 +1,95 @@
+﻿//////////////////////////////////////////////////////////////////////
+/// Desc  FIsland
+/// Time  2026/10/18
+/// Author youlanhai
+//////////////////////////////////////////////////////////////////////
+
+#include "FIsland.hpp"
+#include "FRigidbody.hpp"
+
+NS_FXP_BEGIN
+
+FIslandBuilder::FIslandBuilder()
+{
+}
+
+FIslandBuilder::~FIslandBuilder()
+{
+    clear();
+}
+
+void FIslandBuilder::clear()
+{
+    for (FRigidbody *body : bodies_)
+    {
+        body->islandIndex_ = -1;
+    }
+    bodies_.clear();
+    parents_.clear();
+}
+
+int FIslandBuilder::addBody(FRigidbody *body)
+{
+    if (body->islandIndex_ >= 0)
+    {
+        return body->islandIndex_;
+    }
+
+    int index = (int)bodies_.size();
+    body->islandIndex_ = index;
+    bodies_.push_back(body);
+    parents_.push_back(index);
+    return index;
+}
+
+void FIslandBuilder::link(FRigidbody *a, FRigidbody *b)
+{
+    if (!a->isDynamic() || !b->isDynamic())
+    {
+        return;
+    }
+
+    int rootA = findRoot(addBody(a));
+    int rootB = findRoot(addBody(b));
+    if (rootA == rootB)
+    {
+        return;
+    }
+
+    // 总是挂到索引较小的根上，保证结果与遍历顺序一致
+    if (rootA < rootB)
+    {
+        parents_[rootB] = rootA;
+    }
+    else
+    {
+        parents_[rootA] = rootB;
+    }
+}
+
+int FIslandBuilder::findRoot(int index)
+{
+    int root = index;
+    while (parents_[root] != root)
+    {
+        root = parents_[root];
+    }
+
+    // 路径压缩
+    while (parents_[index] != root)
+    {
+        int next = parents_[index];
+        parents_[index] = root;
+        index = next;
+    }
+    return root;
+}
+
+size_t FIslandBuilder::getMemorySize() const
+{
+    return sizeof(*this) +
+        bodies_.capacity() * sizeof(FRigidbody*) +
+        parents_.capacity() * sizeof(int);
+}
+
+NS_FXP_END
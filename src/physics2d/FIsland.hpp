@@ -0,0 +1,46 @@
+﻿//////////////////////////////////////////////////////////////////////
+/// Desc  FIsland
+/// Time  2026/10/18
+/// Author youlanhai
+//////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "FPhysicsDef.hpp"
+#include <vector>
+
+NS_FXP_BEGIN
+
+/** 刚体岛屿构建器。
+ *  通过并查集把有接触的动态刚体合并成岛屿，岛屿内的刚体同时休眠、同时唤醒。
+ *  静态和动力学刚体不会把两个岛屿连接起来。
+ */
+class FXP_API FIslandBuilder
+{
+public:
+    FIslandBuilder();
+    ~FIslandBuilder();
+
+    /** 清空数据。每帧构建前调用 */
+    void clear();
+
+    /** 添加刚体。重复添加会返回相同的索引 */
+    int addBody(FRigidbody *body);
+
+    /** 连接两个刚体所在的岛屿。非动态刚体会被忽略 */
+    void link(FRigidbody *a, FRigidbody *b);
+
+    /** 获取岛屿的根索引 */
+    int findRoot(int index);
+
+    size_t getBodyCount() const { return bodies_.size(); }
+    FRigidbody* getBody(size_t index) const { return bodies_[index]; }
+
+    size_t getMemorySize() const;
+
+private:
+    std::vector<FRigidbody*>    bodies_;
+    std::vector<int>            parents_;
+};
+
+NS_FXP_END
@@ -9,17 +9,35 @@
 #include "FRigidbody.hpp"
 #include "FCollider.hpp"
 #include "FGJK.hpp"
+#include "FIsland.hpp"
+#include "FContactSolver.hpp"
+#include "FProjectileSystem.hpp"
+#include "FQueryContext.hpp"
+#include "FQuerySnapshot.hpp"
+#include "FWorldState.hpp"
+#include "common/FThreadPool.hpp"
 #include "debug/DebugDraw.hpp"
 #include "debug/LogTool.hpp"
 #include "debug/Profiler.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <limits>
 
 DEFINE_LOG_COMPONENT(LOG_LEVEL_DEBUG, "Physics2D");
 
+/** 逐碰撞对的日志。resimulate时跳过，不格式化参数 */
+#define PHYSICS_VERBOSE(FORMAT, ...) \
+    do { if (!resimulating_) { LOG_VERBOSE(FORMAT, ##__VA_ARGS__); } } while (0)
+
 NS_FXP_BEGIN
 
+/** 着色求解可用的颜色数量，与FRigidbody::colorMask_的位数一致 */
+static const int MAX_SOLVER_COLORS = 64;
+/** 并行求解时，每个线程一次领取的碰撞对数量 */
+static const size_t SOLVER_BATCH_SIZE = 16;
+
 typedef bool(*CollisionMethod)(FCollider *a, FCollider *b, FCollisionInfo &info);
 
 static FVector2 getPenetrateNormalByVelocity(FRigidbody *a, FRigidbody *b)
@@ -36,10 +54,25 @@ static FVector2 getPenetrateNormalByVelocity(FRigidbody *a, FRigidbody *b)
 static void swapCollisionInfo(FCollisionInfo &contact)
 {
     std::swap(contact.a, contact.b);
-    std::swap(contact.pointA, contact.pointB);
+    for (int i = 0; i < contact.pointCount; ++i)
+    {
+        std::swap(contact.points[i].pointA, contact.points[i].pointB);
+    }
+    std::swap(contact.supportA, contact.supportB);
     contact.normal = -contact.normal;
 }
 
+/** 设置单个接触点 */
+static void setSingleContact(FCollisionInfo &info, const FVector2 &pointA, const FVector2 &pointB)
+{
+    info.pointCount = 1;
+    FContactPoint &cp = info.points[0];
+    cp.pointA.setXZ(pointA);
+    cp.pointB.setXZ(pointB);
+    cp.distance = info.distance;
+    cp.id = 0;
+}
+
 static bool testCircleAndCircle(FCircleCollider *a, FCircleCollider *b, FCollisionInfo &info)
 {
     FVector2 dir = b->getWorldCenter() - a->getWorldCenter();
@@ -67,8 +100,9 @@ static bool testCircleAndCircle(FCircleCollider *a, FCircleCollider *b, FCollisi
 
     info.distance = radius - distance;
     info.normal.setXZ(normal);
-    info.pointA.setXZ(a->getWorldCenter() + normal * a->getWorldRadius());
-    info.pointB.setXZ(b->getWorldCenter() - normal * b->getWorldRadius());
+    setSingleContact(info,
+        a->getWorldCenter() + normal * a->getWorldRadius(),
+        b->getWorldCenter() - normal * b->getWorldRadius());
     return true;
 }
 
@@ -94,8 +128,8 @@ static bool testSegmentAndSegment(FSegmentCollider *ca, FSegmentCollider *cb, FC
 
     info.distance = a.length() * t1;
     info.normal.setXZ(ca->getWorldNormal());
-    info.pointA.setXZ(ca->getWorldStart() + ca->getWorldNormal() * info.distance);
-    info.pointB = info.pointA;
+    FVector2 point = ca->getWorldStart() + ca->getWorldNormal() * info.distance;
+    setSingleContact(info, point, point);
     return true;
 }
 
@@ -132,19 +166,182 @@ static bool testSegmentAndCircle(FSegmentCollider *a, FCircleCollider *b, FColli
     {
         // 圆心重合
         info.normal.setXZ(getPenetrateNormalByVelocity(a->getRigidbody(), b->getRigidbody()));
-        info.pointA.setXZ(nearstPoint);
-        info.pointB.setXZ(b->getWorldCenter());
         info.distance = radius;
+        setSingleContact(info, nearstPoint, b->getWorldCenter());
     }
     else
     {
         FVector2 normal = dir / distance;
         // 单位化
         info.normal.setXZ(normal);
-        info.pointA.setXZ(nearstPoint);
-        info.pointB.setXZ(b->getWorldCenter() - normal * b->getWorldRadius());
         info.distance = radius - distance;
+        setSingleContact(info, nearstPoint, b->getWorldCenter() - normal * b->getWorldRadius());
+    }
+    return true;
+}
+
+struct ClipVertex
+{
+    FVector2 point;
+    uint32_t id;
+};
+
+/// 特征id的标记位。保证多边形接触点的id不为0
+static const uint32_t FEATURE_VALID = 1u << 31;
+/// 参考边属于id较大的碰撞体
+static const uint32_t FEATURE_FLIP = 1u << 30;
+/// 入射点是被参考边的侧面裁减出来的
+static const uint32_t FEATURE_CLIPPED = 1u << 15;
+
+/** 查找与dir最接近平行的边。dir需要是单位向量
+ *  @return 边的索引。normal返回单位化之后的边法线
+ */
+static int findAlignedEdge(FPolygonCollider *polygon, const FVector2 &dir, int hint, FVector2 &normal)
+{
+    // 与dir最平行的边，必然与dir方向上的support点相邻
+    int count = (int)polygon->getCount();
+    polygon->getFarthestPointWithHint(dir, hint);
+    int prev = hint > 0 ? hint - 1 : count - 1;
+
+    const FVector2 *normals = polygon->getWorldNormals();
+    FVector2 n1 = normals[prev];
+    FVector2 n2 = normals[hint];
+    n1.normalize();
+    n2.normalize();
+
+    if (n1.dot(dir) > n2.dot(dir))
+    {
+        normal = n1;
+        return prev;
+    }
+    normal = n2;
+    return hint;
+}
+
+/** 用直线裁减线段，保留 dot(normal, p) <= offset 的部分 */
+static int clipSegmentToLine(ClipVertex output[2], const ClipVertex input[2], const FVector2 &normal, FFloat offset, uint32_t clipID)
+{
+    int count = 0;
+
+    FFloat d0 = normal.dot(input[0].point) - offset;
+    FFloat d1 = normal.dot(input[1].point) - offset;
+
+    if (d0 <= FFloat(0))
+    {
+        output[count++] = input[0];
+    }
+    if (d1 <= FFloat(0))
+    {
+        output[count++] = input[1];
+    }
+
+    // 两点分布在直线两侧，计算交点
+    if ((d0 < FFloat(0) && d1 > FFloat(0)) || (d0 > FFloat(0) && d1 < FFloat(0)))
+    {
+        FFloat ratio = d0 / (d0 - d1);
+        output[count].point = input[0].point + (input[1].point - input[0].point) * ratio;
+        output[count].id = clipID;
+        ++count;
+    }
+    return count;
+}
+
+/** 计算两个多边形之间的接触流形，最多生成两个接触点。
+ *  选择与碰撞法线最平行的边作为参考边，用参考边的两个侧面裁减另一个多边形上的入射边。
+ */
+static bool buildPolygonManifold(FPolygonCollider *a, FPolygonCollider *b, const FVector2 &normal, FCollisionInfo &info)
+{
+    if (a->getCount() < 3 || b->getCount() < 3 || normal.isZero())
+    {
+        return false;
+    }
+
+    FVector2 normalA, normalB;
+    int edgeA = findAlignedEdge(a, normal, info.supportA, normalA);
+    int edgeB = findAlignedEdge(b, -normal, info.supportB, normalB);
+
+    // 优先使用a上的边作为参考边，避免两边相近时来回切换
+    bool flip = normalB.dot(-normal) > normalA.dot(normal) + FFloat(0, 0, 5);
+
+    FPolygonCollider *reference = flip ? b : a;
+    FPolygonCollider *incident = flip ? a : b;
+    int referenceEdge = flip ? edgeB : edgeA;
+    FVector2 referenceNormal = flip ? normalB : normalA;
+
+    FVector2 incidentNormal;
+    int incidentEdge = findAlignedEdge(incident, -referenceNormal, flip ? info.supportA : info.supportB, incidentNormal);
+
+    int referenceCount = (int)reference->getCount();
+    int incidentCount = (int)incident->getCount();
+    const FVector2 *referenceVertices = reference->getWorldVertices();
+    const FVector2 *incidentVertices = incident->getWorldVertices();
+
+    const FVector2 &v1 = referenceVertices[referenceEdge];
+    const FVector2 &v2 = referenceVertices[(referenceEdge + 1) % referenceCount];
+
+    FVector2 tangent = v2 - v1;
+    tangent.normalize();
+    if (tangent.isZero())
+    {
+        return false;
+    }
+
+    int incidentNext = (incidentEdge + 1) % incidentCount;
+    ClipVertex incidentPoints[2] = {
+        {incidentVertices[incidentEdge], uint32_t(incidentEdge)},
+        {incidentVertices[incidentNext], uint32_t(incidentNext)},
+    };
+
+    // 用参考边两端的侧面进行裁减
+    ClipVertex clipPoints1[2];
+    ClipVertex clipPoints2[2];
+    if (clipSegmentToLine(clipPoints1, incidentPoints, -tangent, -tangent.dot(v1), FEATURE_CLIPPED | uint32_t(referenceEdge)) < 2)
+    {
+        return false;
+    }
+    if (clipSegmentToLine(clipPoints2, clipPoints1, tangent, tangent.dot(v2), FEATURE_CLIPPED | uint32_t((referenceEdge + 1) % referenceCount)) < 2)
+    {
+        return false;
+    }
+
+    // 特征id与碰撞体的先后顺序无关，碰撞对交换a、b之后仍然能匹配
+    uint32_t featureBase = FEATURE_VALID | (uint32_t(referenceEdge & 0x3fff) << 16);
+    if (reference->getID() > incident->getID())
+    {
+        featureBase |= FEATURE_FLIP;
+    }
+
+    FFloat referenceOffset = referenceNormal.dot(v1);
+    int count = 0;
+    FFloat maxDistance = FFloat(0);
+    for (int i = 0; i < 2; ++i)
+    {
+        FFloat separation = referenceNormal.dot(clipPoints2[i].point) - referenceOffset;
+        if (separation > FFloat(0))
+        {
+            continue;
+        }
+
+        // 入射点在入射多边形上，投影到参考边上得到参考多边形上的点
+        FVector2 onIncident = clipPoints2[i].point;
+        FVector2 onReference = onIncident - referenceNormal * separation;
+
+        FContactPoint &cp = info.points[count++];
+        cp.pointA.setXZ(flip ? onIncident : onReference);
+        cp.pointB.setXZ(flip ? onReference : onIncident);
+        cp.distance = -separation;
+        cp.id = featureBase | (clipPoints2[i].id & 0xffff);
+        maxDistance = FMath::max(maxDistance, cp.distance);
     }
+
+    if (count == 0)
+    {
+        return false;
+    }
+
+    info.pointCount = count;
+    info.distance = maxDistance;
+    info.normal.setXZ(flip ? -referenceNormal : referenceNormal);
     return true;
 }
 
@@ -153,7 +350,10 @@ static bool testWithGJK(FCollider *a, FCollider *b, FCollisionInfo &info)
     LS_PROFILER(PK_PHYSICS_GJK_TEST);
 
     FGJK *gjk = a->getPhysics()->getGJK();
-    if (!gjk->queryCollision(a, b))
+    bool collided = gjk->queryCollision(a, b, info.supportA, info.supportB);
+    info.supportA = gjk->supportIndexA;
+    info.supportB = gjk->supportIndexB;
+    if (!collided)
     {
         return false;
     }
@@ -161,11 +361,51 @@ static bool testWithGJK(FCollider *a, FCollider *b, FCollisionInfo &info)
     info.distance = gjk->penetrationDistance;
     info.normal.setXZ(gjk->penetrationNormal);
 
-    info.pointA.setXZ(gjk->closestOnA);
-    info.pointB.setXZ(gjk->closestOnB);
+    if (a->getType() == FT_POLYGON && b->getType() == FT_POLYGON &&
+        buildPolygonManifold((FPolygonCollider*)a, (FPolygonCollider*)b, gjk->penetrationNormal, info))
+    {
+        return true;
+    }
+
+    setSingleContact(info, gjk->closestOnA, gjk->closestOnB);
     return true;
 }
 
+static bool overlapCircleAndCircle(FCircleCollider *a, FCircleCollider *b, FCollisionInfo &info)
+{
+    FFloat radius = a->getWorldRadius() + b->getWorldRadius();
+    return a->getWorldCenter().distanceToSq(b->getWorldCenter()) <= radius * radius;
+}
+
+static bool overlapSegmentAndCircle(FSegmentCollider *a, FCircleCollider *b, FCollisionInfo &info)
+{
+    FVector2 AB = a->getWorldEnd() - a->getWorldStart();
+    FVector2 AC = b->getWorldCenter() - a->getWorldStart();
+
+    FFloat lengthABSq = AB.lengthSq();
+    if (lengthABSq == 0)
+    {
+        return false;
+    }
+
+    FFloat ratio = FMath::clamp01(AB.dot(AC) / lengthABSq);
+    FVector2 nearstPoint = a->getWorldStart() + AB * ratio;
+
+    FFloat radius = b->getWorldRadius();
+    return b->getWorldCenter().distanceToSq(nearstPoint) <= radius * radius;
+}
+
+static bool overlapWithGJK(FCollider *a, FCollider *b, FCollisionInfo &info)
+{
+    LS_PROFILER(PK_PHYSICS_GJK_TEST);
+
+    FGJK *gjk = a->getPhysics()->getGJK();
+    bool collided = gjk->queryOverlap(a, b, info.supportA, info.supportB);
+    info.supportA = gjk->supportIndexA;
+    info.supportB = gjk->supportIndexB;
+    return collided;
+}
+
 static CollisionMethod collisionTestMethods[3][3] = {
     //          circle                               segment                         polygon
     /*circle */ {(CollisionMethod)testCircleAndCircle, nullptr, nullptr},
@@ -174,12 +414,14 @@ static CollisionMethod collisionTestMethods[3][3] = {
 };
 
 
+/** info中的supportA、supportB需要与参数a、b对应 */
 static bool collisionTest(FCollider *a, FCollider *b, FCollisionInfo &info)
 {
     LS_PROFILER(PK_PHYSICS_COLLISION_TEST);
     if (a->getType() < b->getType())
     {
         std::swap(a, b);
+        std::swap(info.supportA, info.supportB);
     }
 
     info.a = a;
@@ -188,14 +430,87 @@ static bool collisionTest(FCollider *a, FCollider *b, FCollisionInfo &info)
     return method(a, b, info);
 }
 
+/// 仅判断是否相交的测试方法。不计算穿透深度、法线和接触点
+static CollisionMethod overlapTestMethods[3][3] = {
+    //          circle                                  segment                         polygon
+    /*circle */ {(CollisionMethod)overlapCircleAndCircle, nullptr, nullptr},
+    /*segment*/ {(CollisionMethod)overlapSegmentAndCircle, (CollisionMethod)testSegmentAndSegment, nullptr},
+    /*polygon*/ {(CollisionMethod)overlapWithGJK, (CollisionMethod)overlapWithGJK, (CollisionMethod)overlapWithGJK},
+};
+
+/** 与collisionTest相同，但只判断是否相交。用于触发器和查询 */
+static bool overlapTest(FCollider *a, FCollider *b, FCollisionInfo &info)
+{
+    LS_PROFILER(PK_PHYSICS_COLLISION_TEST);
+    if (a->getType() < b->getType())
+    {
+        std::swap(a, b);
+        std::swap(info.supportA, info.supportB);
+    }
+
+    info.a = a;
+    info.b = b;
+    CollisionMethod method = overlapTestMethods[a->getType()][b->getType()];
+    return method(a, b, info);
+}
+
+/** 与overlapTest相同，GJK使用调用者提供的实例，不访问物理世界的共享状态 */
+static bool overlapTest(FGJK *gjk, FCollider *a, FCollider *b, FCollisionInfo &info)
+{
+    if (a->getType() < b->getType())
+    {
+        std::swap(a, b);
+        std::swap(info.supportA, info.supportB);
+    }
+
+    info.a = a;
+    info.b = b;
+    CollisionMethod method = overlapTestMethods[a->getType()][b->getType()];
+    if (method != (CollisionMethod)overlapWithGJK)
+    {
+        return method(a, b, info);
+    }
+
+    bool collided = gjk->queryOverlap(a, b, info.supportA, info.supportB);
+    info.supportA = gjk->supportIndexA;
+    info.supportB = gjk->supportIndexB;
+    return collided;
+}
+
+/** 触发器和动力学刚体不参与分离计算 */
+static bool isTriggerPair(FCollider *a, FCollider *b)
+{
+    return a->isTrigger() || b->isTrigger() ||
+        a->getRigidbody()->isKinematic() || b->getRigidbody()->isKinematic();
+}
+
+/** 碰撞对的两个刚体都在休眠中 */
+static bool isSleepingPair(FColliderPair &pair)
+{
+    return !pair.a->getRigidbody()->isActive() && !pair.b->getRigidbody()->isActive();
+}
+
 FPhysics2D::FPhysics2D()
 {
     dynamicTree_ = new FBVHTree();
     staticTree_ = new FBVHTree();
     gjk_ = new FGJK();
+    queryContext_ = new FQueryContext();
+    islandBuilder_ = new FIslandBuilder();
+    contactSolver_ = new FContactSolver();
+    projectileSystem_ = new FProjectileSystem(this);
 
     staticRigidbody_ = new FRigidbody(true);
     staticRigidbody_->setPhysics(this);
+
+    castRigidbody_ = new FRigidbody(true);
+    castCircle_ = new FCircleCollider();
+    castPolygon_ = new FPolygonCollider(FFloat(1), FFloat(1));
+    castRigidbody_->addCollider(castCircle_.get());
+    castRigidbody_->addCollider(castPolygon_.get());
+    // 查询用的碰撞体不加入物理世界，也不分配id，只需要能通过physics_访问到gjk
+    castCircle_->physics_ = this;
+    castPolygon_->physics_ = this;
 }
 
 FPhysics2D::~FPhysics2D()
@@ -210,7 +525,25 @@ FPhysics2D::~FPhysics2D()
     delete staticTree_;
     staticTree_ = nullptr;
 
+    delete islandBuilder_;
+    islandBuilder_ = nullptr;
+
+    delete contactSolver_;
+    contactSolver_ = nullptr;
+
+    delete projectileSystem_;
+    projectileSystem_ = nullptr;
+
+    delete queryContext_;
+    queryContext_ = nullptr;
+
+    delete threadPool_;
+    threadPool_ = nullptr;
+
     staticRigidbody_ = nullptr;
+    castCircle_ = nullptr;
+    castPolygon_ = nullptr;
+    castRigidbody_ = nullptr;
 }
 
 void FPhysics2D::init()
@@ -222,9 +555,12 @@ void FPhysics2D::clear()
 {
     idCounter = 0;
     tickStamp = 0;
+    accumulatedTime_ = FFloat(0);
 
     dynamicTree_->clear();
     staticTree_->clear();
+    islandBuilder_->clear();
+    projectileSystem_->clear();
 
     activeBodies_.clear();
     colliderPairs_.clear();
@@ -242,11 +578,20 @@ void FPhysics2D::tick(FFloat deltaTime)
 {
     Profiler::getDefault()->begin(PK_PHYSICS_TICK); // 始终统计
     ++tickStamp;
+
+    // 记录上一次tick的结果，用于插值
+    for (auto& pair : activeBodies_)
+    {
+        pair.second->savePrevTransform();
+    }
+
+    bool useSubsteps = solverSubsteps_ > 1;
+    FFloat stepTime = useSubsteps ? deltaTime / solverSubsteps_ : deltaTime;
     
     // 更新刚体运动属性
     for (auto& pair : activeBodies_)
     {
-        pair.second->update(deltaTime);
+        pair.second->update(stepTime);
         if (pair.second->isTransformDirty())
         {
             pair.second->updateTransform();
@@ -268,18 +613,18 @@ void FPhysics2D::tick(FFloat deltaTime)
 
     LS_PROFILER_BEGIN(PK_PHYSICS_NOTIFY);
     // 更新碰撞对
-    std::vector<uint64_t> pendingRemove;
+    pendingRemovePairs_.clear();
     for (auto &pair : colliderPairs_)
     {
         updateColliderPair(deltaTime, pair.second);
         if (pair.second.state == FColliderPair::STATE_EXIT)
         {
-            pendingRemove.push_back(pair.first);
+            pendingRemovePairs_.push_back(pair.first);
         }
     }
     LS_PROFILER_END(PK_PHYSICS_NOTIFY);
 
-    for (uint64_t id : pendingRemove)
+    for (uint64_t id : pendingRemovePairs_)
     {
         auto it = colliderPairs_.find(id);
         if (it != colliderPairs_.end())
@@ -288,152 +633,494 @@ void FPhysics2D::tick(FFloat deltaTime)
         }
     }
 
-    LS_PROFILER_BEGIN(PK_PHYSICS_PRE_SEPERATION);
-    for (auto &pair : colliderPairs_)
+    LS_PROFILER_BEGIN(PK_PHYSICS_ISLAND);
+    buildIslands();
+    LS_PROFILER_END(PK_PHYSICS_ISLAND);
+
+    if (useSubsteps)
     {
-        if (!pair.second.isTrigger)
+        solveSubsteps(deltaTime);
+    }
+    else if (solverThreadCount_ > 0)
+    {
+        solveColoredPairs(deltaTime);
+    }
+    else
+    {
+        LS_PROFILER_BEGIN(PK_PHYSICS_PRE_SEPERATION);
+        for (auto &pair : colliderPairs_)
         {
-            doPreSeperation(deltaTime, pair.second);
+            if (!pair.second.isTrigger && !isSleepingPair(pair.second))
+            {
+                doPreSeperation(deltaTime, pair.second);
+            }
         }
-    }
-    LS_PROFILER_END(PK_PHYSICS_PRE_SEPERATION);
+        LS_PROFILER_END(PK_PHYSICS_PRE_SEPERATION);
 
-    LS_PROFILER_BEGIN(PK_PHYSICS_POST_SEPERATION);
-    for (int i = 0; i < maxIteration; ++i)
-    {
-        for(auto &pair : colliderPairs_)
+        LS_PROFILER_BEGIN(PK_PHYSICS_POST_SEPERATION);
+        lastIteration_ = 0;
+        while (lastIteration_ < maxIteration)
         {
-            if (!pair.second.isTrigger)
+            FFloat maxDelta;
+            for(auto &pair : colliderPairs_)
+            {
+                if (!pair.second.isTrigger && !isSleepingPair(pair.second))
+                {
+                    maxDelta = FMath::max(maxDelta, doPostSeperation(deltaTime, pair.second));
+                }
+            }
+
+            ++lastIteration_;
+            if (lastIteration_ >= minIteration_ && maxDelta <= solverTolerance_)
             {
-                doPostSeperation(deltaTime, pair.second);
+                break;
             }
         }
+        LS_PROFILER_END(PK_PHYSICS_POST_SEPERATION);
     }
-    LS_PROFILER_END(PK_PHYSICS_POST_SEPERATION);
+
+    LS_PROFILER_BEGIN(PK_PHYSICS_CCD);
+    solveContinuousCollision(deltaTime);
+    LS_PROFILER_END(PK_PHYSICS_CCD);
 
     // 更新刚体运动属性
     for (auto& pair : activeBodies_)
     {
-        pair.second->postUpdate(deltaTime);
-    }
-
-    // 移除不活跃的刚体
-    for (auto it = activeBodies_.begin(); it != activeBodies_.end(); )
-    {
-        FRigidbodyPtr rigidbody = it->second;
-        if (rigidbody->canSleep())
+        if (useSubsteps)
         {
-            rigidbody->isActive_ = false;
-            it = activeBodies_.erase(it);
+            pair.second->postSubsteps(deltaTime, stepTime);
         }
         else
         {
-            ++it;
+            pair.second->postUpdate(deltaTime);
         }
     }
 
+    // 移除不活跃的刚体
+    LS_PROFILER_BEGIN(PK_PHYSICS_ISLAND);
+    sleepIslands();
+    LS_PROFILER_END(PK_PHYSICS_ISLAND);
+
+    projectileSystem_->update(deltaTime);
+
+    if (snapshotEnabled_ && !resimulating_)
+    {
+        publishQuerySnapshot();
+    }
+
     assert(activeBodies_.size() <= rigidbodys_.size() && "remove active rigidbody failed!");
 
     Profiler::getDefault()->end(PK_PHYSICS_TICK);
 }
 
-class QueryColliderPair
+void FPhysics2D::setQuerySnapshotEnable(bool enable)
 {
-public:
-    FPhysics2D *physics;
-    FCollider *collider;
-
-    bool operator()(FBVHNode *node)
+    snapshotEnabled_ = enable;
+    if (enable)
     {
-        if (!collider->canCollideWith(node->collider.get()))
-        {
-            return false;
-        }
+        // 立即发布一份，第一次tick之前也可以查询
+        publishQuerySnapshot();
+    }
+    else
+    {
+        std::atomic_store(&querySnapshot_, std::shared_ptr<const FQuerySnapshot>());
+        spareSnapshot_.reset();
+    }
+}
 
-        if (physics->existColliderPair(collider, node->collider.get()))
-        {
-            return false;
-        }
+std::shared_ptr<const FQuerySnapshot> FPhysics2D::getQuerySnapshot() const
+{
+    return std::atomic_load(&querySnapshot_);
+}
 
-        FCollisionInfo info;
-        if (collisionTest(collider, node->collider.get(), info))
-        {
-            physics->addColliderPair(info);
-        }
+void FPhysics2D::publishQuerySnapshot()
+{
+    LS_PROFILER(PK_PHYSICS_SNAPSHOT);
 
-        return false;
+    // 旧快照已经不再发布，读者只会释放它。引用计数为1说明没有读者了，可以安全复用
+    std::shared_ptr<FQuerySnapshot> snapshot;
+    if (spareSnapshot_ && spareSnapshot_.use_count() == 1)
+    {
+        // use_count是relaxed读取，需要与读者释放引用时的release配对，保证读者的读取都发生在改写之前
+        std::atomic_thread_fence(std::memory_order_acquire);
+        snapshot.swap(spareSnapshot_);
+    }
+    else
+    {
+        snapshot = std::make_shared<FQuerySnapshot>();
     }
-};
 
-// 查询碰撞对
-void FPhysics2D::queryColliderPairs()
+    snapshot->build(dynamicTree_, staticTree_, staticShapeStamp_, tickStamp);
+
+    std::shared_ptr<const FQuerySnapshot> old = std::atomic_exchange(&querySnapshot_, std::shared_ptr<const FQuerySnapshot>(snapshot));
+    spareSnapshot_ = std::const_pointer_cast<FQuerySnapshot>(old);
+}
+
+void FPhysics2D::saveState(FWorldState &state)
 {
-    //LS_PROFILER(PK_PHYSICS_JUDGE_PAIR);
-    Profiler::getDefault()->begin(PK_PHYSICS_JUDGE_PAIR);
+    LS_PROFILER(PK_PHYSICS_SAVE_STATE);
 
-    QueryColliderPair query{ this, nullptr };
-    for (auto& pair : activeBodies_)
+    state.tickStamp_ = tickStamp;
+    state.idCounter_ = idCounter;
+    state.accumulatedTime_ = accumulatedTime_;
+
+    size_t count = rigidbodys_.size();
+    state.bodies_.resize(count);
+    state.bodyStates_.resize(count);
+    state.colliders_.clear();
+    for (size_t i = 0; i < count; ++i)
     {
-        SmartPtr<FRigidbody> r = pair.second;
-        if (r->isStatic())
-        {
-            continue;
-        }
+        FRigidbody *rigidbody = rigidbodys_[i].get();
+        state.bodies_[i] = rigidbody;
+        rigidbody->saveState(state.bodyStates_[i]);
 
-        for (size_t i = 0; i < r->getNumColliders(); ++i)
+        for (auto &collider : rigidbody->colliders_)
         {
-            LS_PROFILER(PK_PHYSICS_COLLIDERCAST);
-
-            FCollider *collider = r->getCollider(i);
-            query.collider = collider;
-
-            dynamicTree_->queryCollider(collider->getBounds(), query);
-            staticTree_->queryCollider(collider->getBounds(), query);
+            FColliderState colliderState;
+            colliderState.collider = collider.get();
+            colliderState.bounds = collider->bb_;
+            colliderState.filter = collider->filter_;
+            colliderState.isTrigger = collider->isTrigger_;
+            state.colliders_.push_back(colliderState);
         }
     }
 
-    Profiler::getDefault()->end();
-}
+    state.activeBodies_.clear();
+    for (auto &pair : activeBodies_)
+    {
+        state.activeBodies_.push_back(pair.second.get());
+    }
 
-void FPhysics2D::rebuildTree()
-{
-    staticTree_->rebuild();
-    dynamicTree_->rebuild();
+    state.pairs_.resize(colliderPairs_.size());
+    size_t index = 0;
+    for (auto &pair : colliderPairs_)
+    {
+        FColliderPairState &pairState = state.pairs_[index++];
+        pairState.id = pair.first;
+        pairState.a = pair.second.a.get();
+        pairState.b = pair.second.b.get();
+        pairState.stamp = pair.second.stamp;
+        pairState.isTrigger = pair.second.isTrigger;
+        pairState.state = pair.second.state;
+        pairState.collisionInfo = pair.second.collisionInfo;
+    }
+
+    dynamicTree_->saveState(state.dynamicTree_);
+    staticTree_->saveState(state.staticTree_);
+    projectileSystem_->saveState(state.projectiles_);
 }
 
-class QueryColliderByPoint
+bool FPhysics2D::restoreState(const FWorldState &state, bool publishSnapshot)
 {
-public:
-    FVector2 point;
-    FFloat radius;
-    SmartPtr<FCollider> collider;
+    LS_PROFILER(PK_PHYSICS_RESTORE_STATE);
 
-    QueryColliderByPoint(const FVector2 &point, FFloat radius)
+    // 先检查刚体和碰撞体是否与保存时相同，失败时不修改任何数据
+    size_t count = rigidbodys_.size();
+    if (state.bodies_.size() != count)
     {
-        this->point = point;
-        this->radius = radius;
+        LOG_ERROR("Restore state failed: rigidbody count changed");
+        return false;
     }
 
-    bool operator()(FBVHNode *node)
+    size_t colliderIndex = 0;
+    for (size_t i = 0; i < count; ++i)
     {
-        if (node->collider->overlapPoint(point, radius))
+        FRigidbody *rigidbody = rigidbodys_[i].get();
+        if (rigidbody != state.bodies_[i] || rigidbody->getID() != state.bodyStates_[i].id)
         {
-            collider = node->collider;
-            return true;
+            LOG_ERROR("Restore state failed: rigidbody %d changed", rigidbody->getID());
+            return false;
         }
-        return false;
+
+        if (rigidbody->getType() != state.bodyStates_[i].type)
+        {
+            LOG_ERROR("Restore state failed: type of rigidbody %d changed", rigidbody->getID());
+            return false;
+        }
+
+        for (auto &collider : rigidbody->colliders_)
+        {
+            if (colliderIndex >= state.colliders_.size() || state.colliders_[colliderIndex].collider != collider.get())
+            {
+                LOG_ERROR("Restore state failed: colliders of rigidbody %d changed", rigidbody->getID());
+                return false;
+            }
+            ++colliderIndex;
+        }
+    }
+
+    if (colliderIndex != state.colliders_.size())
+    {
+        LOG_ERROR("Restore state failed: collider count changed");
+        return false;
+    }
+
+    tickStamp = state.tickStamp_;
+    idCounter = state.idCounter_;
+    accumulatedTime_ = state.accumulatedTime_;
+
+    // 只有静态碰撞体真的变化了，快照才需要重新复制静态部分
+    bool staticChanged = false;
+
+    colliderIndex = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        FRigidbody *rigidbody = rigidbodys_[i].get();
+        const FRigidbodyState &bodyState = state.bodyStates_[i];
+        if (rigidbody->isStatic() && (rigidbody->position != bodyState.position ||
+            rigidbody->angle != bodyState.angle || rigidbody->scale != bodyState.scale))
+        {
+            staticChanged = true;
+        }
+        rigidbody->restoreState(bodyState);
+
+        // 包围盒可能是在刚体移动之前计算的，使用保存的值，保证与BVH树一致
+        for (auto &collider : rigidbody->colliders_)
+        {
+            const FColliderState &colliderState = state.colliders_[colliderIndex++];
+            if (rigidbody->isStatic() && (collider->bb_ != colliderState.bounds ||
+                collider->filter_ != colliderState.filter || collider->isTrigger_ != colliderState.isTrigger))
+            {
+                staticChanged = true;
+            }
+            collider->bb_ = colliderState.bounds;
+            collider->filter_ = colliderState.filter;
+            collider->isTrigger_ = colliderState.isTrigger;
+        }
+    }
+
+    // map与保存的数组都按id排序，合并时只增删有差异的部分，相同的条目原地更新
+    auto itBody = activeBodies_.begin();
+    for (FRigidbody *rigidbody : state.activeBodies_)
+    {
+        uint32_t id = rigidbody->getID();
+        while (itBody != activeBodies_.end() && itBody->first < id)
+        {
+            itBody = activeBodies_.erase(itBody);
+        }
+        if (itBody == activeBodies_.end() || itBody->first != id)
+        {
+            itBody = activeBodies_.emplace_hint(itBody, id, rigidbody);
+        }
+        ++itBody;
+    }
+    activeBodies_.erase(itBody, activeBodies_.end());
+
+    auto itPair = colliderPairs_.begin();
+    for (const FColliderPairState &pairState : state.pairs_)
+    {
+        while (itPair != colliderPairs_.end() && itPair->first < pairState.id)
+        {
+            itPair = colliderPairs_.erase(itPair);
+        }
+        if (itPair == colliderPairs_.end() || itPair->first != pairState.id)
+        {
+            itPair = colliderPairs_.emplace_hint(itPair, pairState.id, FColliderPair());
+        }
+
+        FColliderPair &pair = itPair->second;
+        pair.id = pairState.id;
+        pair.a = pairState.a;
+        pair.b = pairState.b;
+        pair.stamp = pairState.stamp;
+        pair.isTrigger = pairState.isTrigger;
+        pair.state = pairState.state;
+        pair.collisionInfo = pairState.collisionInfo;
+        ++itPair;
+    }
+    colliderPairs_.erase(itPair, colliderPairs_.end());
+
+    dynamicTree_->restoreState(state.dynamicTree_);
+    staticTree_->restoreState(state.staticTree_);
+    if (staticChanged)
+    {
+        onStaticShapeChange();
+    }
+    projectileSystem_->restoreState(state.projectiles_);
+
+    if (snapshotEnabled_ && publishSnapshot)
+    {
+        publishQuerySnapshot();
+    }
+    return true;
+}
+
+int FPhysics2D::advance(FFloat elapsedTime)
+{
+    if (fixedDeltaTime_ <= 0)
+    {
+        return 0;
+    }
+
+    accumulatedTime_ += elapsedTime;
+
+    int steps = 0;
+    while (accumulatedTime_ >= fixedDeltaTime_ && steps < maxStepsPerAdvance_)
+    {
+        tick(fixedDeltaTime_);
+        accumulatedTime_ -= fixedDeltaTime_;
+        ++steps;
+    }
+
+    // 追不上的整步直接丢弃，保留不足一步的部分，插值因子不会因此跳变。
+    // 两者都是正数，对原始值取模等价于反复减去步长
+    if (accumulatedTime_ >= fixedDeltaTime_)
+    {
+        accumulatedTime_ = FFloat(true, accumulatedTime_.value % fixedDeltaTime_.value);
+    }
+    return steps;
+}
+
+void FPhysics2D::resimulate(FFloat deltaTime, int count)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+
+    LS_PROFILER(PK_PHYSICS_RESIMULATE);
+
+    resimulating_ = true;
+    Profiler::getDefault()->pause();
+    for (int i = 0; i < count; ++i)
+    {
+        tick(deltaTime);
+    }
+    Profiler::getDefault()->resume();
+    resimulating_ = false;
+
+    if (snapshotEnabled_)
+    {
+        publishQuerySnapshot();
+    }
+}
+
+FFloat FPhysics2D::getInterpolationAlpha() const
+{
+    if (fixedDeltaTime_ <= 0)
+    {
+        return FFloat(1);
+    }
+    return accumulatedTime_ / fixedDeltaTime_;
+}
+
+class QueryColliderPair
+{
+public:
+    FPhysics2D *physics;
+    FCollider *collider;
+
+    bool operator()(FBVHNode *node)
+    {
+        if (!collider->canCollideWith(node->collider.get()))
+        {
+            return false;
+        }
+
+        FColliderPair *pair = physics->findColliderPair(collider, node->collider.get());
+        if (pair != nullptr && pair->stamp == physics->getTickStamp())
+        {
+            return false;
+        }
+
+        FCollisionInfo info;
+        if (pair != nullptr)
+        {
+            // 沿用上一帧的support顶点，作为爬山查找的起点
+            const FCollisionInfo &last = pair->collisionInfo;
+            bool same = last.a == collider;
+            info.supportA = same ? last.supportA : last.supportB;
+            info.supportB = same ? last.supportB : last.supportA;
+        }
+
+        // 触发器不需要穿透信息，只做相交判断
+        bool collided = isTriggerPair(collider, node->collider.get()) ?
+            overlapTest(collider, node->collider.get(), info) :
+            collisionTest(collider, node->collider.get(), info);
+        if (collided)
+        {
+            physics->addColliderPair(info);
+        }
+
+        return false;
+    }
+};
+
+// 查询碰撞对
+void FPhysics2D::queryColliderPairs()
+{
+    //LS_PROFILER(PK_PHYSICS_JUDGE_PAIR);
+    Profiler::getDefault()->begin(PK_PHYSICS_JUDGE_PAIR);
+
+    QueryColliderPair query{ this, nullptr };
+    for (auto& pair : activeBodies_)
+    {
+        SmartPtr<FRigidbody> r = pair.second;
+        if (r->isStatic())
+        {
+            continue;
+        }
+
+        for (size_t i = 0; i < r->getNumColliders(); ++i)
+        {
+            LS_PROFILER(PK_PHYSICS_COLLIDERCAST);
+
+            FCollider *collider = r->getCollider(i);
+            query.collider = collider;
+
+            dynamicTree_->queryCollider(collider->getBounds(), query);
+            staticTree_->queryCollider(collider->getBounds(), query);
+        }
+    }
+
+    Profiler::getDefault()->end();
+}
+
+void FPhysics2D::rebuildTree()
+{
+    staticTree_->rebuild();
+    dynamicTree_->rebuild();
+}
+
+class QueryColliderByPoint
+{
+public:
+    FVector2 point;
+    FFloat radius;
+    /** 不使用SmartPtr，多线程查询时不能修改碰撞体的引用计数 */
+    FCollider *collider = nullptr;
+
+    QueryColliderByPoint(const FVector2 &point, FFloat radius)
+    {
+        this->point = point;
+        this->radius = radius;
+    }
+
+    bool operator()(FBVHNode *node)
+    {
+        if (node->collider->overlapPoint(point, radius))
+        {
+            collider = node->collider.get();
+            return true;
+        }
+        return false;
     }
 };
 
 FCollider* FPhysics2D::pointCast(const FVector3 & point, FFloat radius)
+{
+    return pointCast(point, radius, *queryContext_);
+}
+
+FCollider* FPhysics2D::pointCast(const FVector3 &point, FFloat radius, FQueryContext &context) const
 {
     QueryColliderByPoint query(point.toXZ(), radius);
     FBB bb(point.toXZ(), radius);
-    if (!dynamicTree_->queryCollider(bb, query))
+    if (!dynamicTree_->queryCollider(bb, query, context.getStack()))
     {
-        staticTree_->queryCollider(bb, query);
+        staticTree_->queryCollider(bb, query, context.getStack());
     }
-    return query.collider.get();
+    return query.collider;
 }
 
 
@@ -471,6 +1158,12 @@ public:
 };
 
 bool FPhysics2D::linecast(const FVector3 &start, const FVector3 &end, FFloat radius, const FColliderFilter &filter, FRaycastHit &hit)
+{
+    return linecast(start, end, radius, filter, hit, *queryContext_);
+}
+
+bool FPhysics2D::linecast(const FVector3 &start, const FVector3 &end, FFloat radius, const FColliderFilter &filter, FRaycastHit &hit,
+    FQueryContext &context) const
 {
     LS_PROFILER(PK_PHYSICS_LINECAST);
 
@@ -479,401 +1172,1888 @@ bool FPhysics2D::linecast(const FVector3 &start, const FVector3 &end, FFloat rad
 
     hit.distance = ray.distance;
 
-    dynamicTree_->queryByRay(ray.start, ray.normal, hit.distance, query);
-    staticTree_->queryByRay(ray.start, ray.normal, hit.distance, query);
+    dynamicTree_->queryByRay(ray.start, ray.normal, hit.distance, query, context.getStack());
+    staticTree_->queryByRay(ray.start, ray.normal, hit.distance, query, context.getStack());
     return query.collide;
 }
 
+/** 按距离排序。距离相同时按碰撞体的id排序，保证结果确定 */
+static bool compareHitDistance(const FRaycastHit &a, const FRaycastHit &b)
+{
+    if (a.distance != b.distance)
+    {
+        return a.distance < b.distance;
+    }
+    return a.collider->getID() < b.collider->getID();
+}
 
-class QueryColliderByCollider
+/** 查询与射线相交的所有碰撞体 */
+class QueryAllByRay
 {
-    FCollider *collider;
-    FCollisionInfo info;
-    bool all;
 public:
-    std::vector<FCollider*> targets;
+    FRay ray;
+    const FColliderFilter &filter;
+    std::vector<FRaycastHit> &hits;
+    size_t begin;
+    size_t maxHits;
+    FRaycastHit tempHit;
 
-    QueryColliderByCollider(FCollider *_collider, bool _all)
-        : collider(_collider)
-        , all(_all)
+    QueryAllByRay(const FRay &_ray, const FColliderFilter &_filter, std::vector<FRaycastHit> &_hits, size_t _maxHits)
+        : ray(_ray)
+        , filter(_filter)
+        , hits(_hits)
+        , begin(_hits.size())
+        , maxHits(_maxHits)
     {
     }
 
-    bool operator()(FBVHNode *node)
+    bool isFull() const { return maxHits > 0 && hits.size() - begin >= maxHits; }
+
+    FFloat operator()(FBVHNode *node)
     {
-        if (collider->canCollideWith(node->collider.get()) &&
-            collisionTest(collider, node->collider.get(), info))
+        FCollider *collider = node->collider.get();
+        if (!collider->isTrigger() && filter.canCollide(collider->getFilter()) && collider->rayCast(ray, tempHit))
         {
-            targets.push_back(collider != info.a ? info.a : info.b);
-            return !all;
+            if (!isFull())
+            {
+                hits.push_back(tempHit);
+                if (isFull())
+                {
+                    std::make_heap(hits.begin() + begin, hits.end(), compareHitDistance);
+                }
+            }
+            else if (compareHitDistance(tempHit, hits[begin]))
+            {
+                // 堆顶是保留的结果中最远的，替换掉它
+                std::pop_heap(hits.begin() + begin, hits.end(), compareHitDistance);
+                hits.back() = tempHit;
+                std::push_heap(hits.begin() + begin, hits.end(), compareHitDistance);
+            }
         }
-        return false;
+
+        // 数量满了之后，只需要查询比最远结果更近的结点
+        return isFull() ? hits[begin].distance : ray.distance + FFloat(1);
     }
 };
 
-FCollider* FPhysics2D::colliderCast(FCollider *collider)
+int FPhysics2D::linecastAll(const FVector3 &start, const FVector3 &end, const FColliderFilter &filter,
+    std::vector<FRaycastHit> &hits, size_t maxHits)
 {
-    QueryColliderByCollider query(collider, false);
-    if (dynamicTree_->queryCollider(collider->getBounds(), query))
-    {
-        return query.targets[0];
-    }
+    LS_PROFILER(PK_PHYSICS_LINECAST);
 
-    if (staticTree_->queryCollider(collider->getBounds(), query))
-    {
-        return query.targets[0];
-    }
+    FRay ray(start.toXZ(), end.toXZ());
+    QueryAllByRay query(ray, filter, hits, maxHits);
 
-    return nullptr;
-}
+    dynamicTree_->queryByRay(ray.start, ray.normal, ray.distance, query);
+    staticTree_->queryByRay(ray.start, ray.normal, query.isFull() ? hits[query.begin].distance : ray.distance, query);
 
-bool FPhysics2D::colliderCastAll(FCollider *collider, std::vector<FCollider*> &targets)
-{
-    QueryColliderByCollider query(collider, true);
-    dynamicTree_->queryCollider(collider->getBounds(), query);
-    staticTree_->queryCollider(collider->getBounds(), query);
-    targets.swap(query.targets);
-    return !targets.empty();
+    std::sort(hits.begin() + query.begin, hits.end(), compareHitDistance);
+    return (int)(hits.size() - query.begin);
 }
 
-void FPhysics2D::addRigidbody(FRigidbody * rigidbody)
+/** 射线包查询最近的碰撞体 */
+class QueryPacketByRay
 {
-    if (rigidbody->isInPhysics())
-    {
-        return;
-    }
+public:
+    const FRay *rays;
+    const FColliderFilter *filters;
+    FRaycastHit *hits;
+    FRaycastHit tempHit;
 
-    if (rigidbody->getPhysics() == nullptr)
-    {
-        rigidbody->setPhysics(this);
-    }
-    else if (rigidbody->getPhysics() != this)
+    FFloat operator()(FBVHNode *node, int i)
     {
-        LOG_ERROR("Rigidbody not created by this physics");
-        return;
+        FCollider *collider = node->collider.get();
+        if (!collider->isTrigger() && filters[i].canCollide(collider->getFilter()) &&
+            collider->rayCast(rays[i], tempHit) &&
+            (hits[i].collider == nullptr || tempHit.distance < hits[i].distance))
+        {
+            hits[i] = tempHit;
+            return tempHit.distance;
+        }
+        return FMath::FloatMax;
     }
+};
 
-    rigidbodys_.push_back(rigidbody);
-    rigidbody->onAddToPhysicsWorld();
-}
-
-void FPhysics2D::removeRigidbody(FRigidbody * rigidbody)
+int FPhysics2D::linecastBatch(const FRay *rays, const FColliderFilter *filters, size_t count, FRaycastHit *hits)
 {
-    if (!rigidbody->isInPhysics())
-    {
-        return;
-    }
+    LS_PROFILER(PK_PHYSICS_LINECAST);
 
-    if (rigidbody->getPhysics() != this)
+    FRay packet[FBVHTree::RAY_PACKET_SIZE];
+    int numHits = 0;
+
+    for (size_t begin = 0; begin < count; begin += FBVHTree::RAY_PACKET_SIZE)
     {
-        LOG_ERROR("Rigidbody not created by this physics");
-        return;
+        int n = (int)std::min(count - begin, (size_t)FBVHTree::RAY_PACKET_SIZE);
+        for (int i = 0; i < n; ++i)
+        {
+            packet[i] = rays[begin + i];
+
+            FRaycastHit &hit = hits[begin + i];
+            hit.collider = nullptr;
+            hit.distance = packet[i].distance;
+        }
+
+        // 查询过程中会缩短packet中的射线，用于剔除更远的结点。两棵树共享同一个射线包，静态树只查询更近的碰撞体。
+        // 与碰撞体求交仍使用原始射线，保证结果与linecast一致
+        QueryPacketByRay query{ rays + begin, filters + begin, hits + begin, FRaycastHit() };
+        dynamicTree_->queryByRayPacket(packet, n, query);
+        staticTree_->queryByRayPacket(packet, n, query);
+
+        for (int i = 0; i < n; ++i)
+        {
+            if (hits[begin + i].collider != nullptr)
+            {
+                ++numHits;
+            }
+        }
+    }
+    return numHits;
+}
+
+/** 查询阻挡线段的任意碰撞体 */
+class QueryOcclusionByRay
+{
+public:
+    FRay ray;
+    const FColliderFilter &filter;
+    FRaycastHit tempHit;
+    /** 不参与阻挡的碰撞体，通常是视线的目标 */
+    FCollider *ignore = nullptr;
+
+    QueryOcclusionByRay(const FRay &_ray, const FColliderFilter &_filter)
+        : ray(_ray)
+        , filter(_filter)
+    {
+    }
+
+    bool operator()(FBVHNode *node)
+    {
+        FCollider *collider = node->collider.get();
+        return collider != ignore && !collider->isTrigger() && filter.canCollide(collider->getFilter()) && collider->rayCast(ray, tempHit);
+    }
+};
+
+bool FPhysics2D::occluded(const FVector3 &start, const FVector3 &end, const FColliderFilter &filter)
+{
+    return occluded(start, end, filter, *queryContext_);
+}
+
+bool FPhysics2D::occluded(const FVector3 &start, const FVector3 &end, const FColliderFilter &filter, FQueryContext &context) const
+{
+    LS_PROFILER(PK_PHYSICS_LINECAST);
+
+    FRay ray(start.toXZ(), end.toXZ());
+    if (ray.distance <= 0)
+    {
+        return false;
+    }
+
+    QueryOcclusionByRay query(ray, filter);
+    // 静态碰撞体通常是墙体，更容易阻挡视线，先查询
+    return staticTree_->queryAnyByRay(ray.start, ray.end, query, context.getStack()) ||
+        dynamicTree_->queryAnyByRay(ray.start, ray.end, query, context.getStack());
+}
+
+/** 射线包查询阻挡射线的任意碰撞体 */
+class QueryPacketOcclusion
+{
+public:
+    const FRay *rays;
+    const FColliderFilter *filters;
+    bool *results;
+    FRaycastHit tempHit;
+
+    FFloat operator()(FBVHNode *node, int i)
+    {
+        FCollider *collider = node->collider.get();
+        if (!collider->isTrigger() && filters[i].canCollide(collider->getFilter()) && collider->rayCast(rays[i], tempHit))
+        {
+            // 返回0，结束这条射线的查询
+            results[i] = true;
+            return FFloat(0);
+        }
+        return FMath::FloatMax;
+    }
+};
+
+int FPhysics2D::occludedBatch(const FRay *rays, const FColliderFilter *filters, size_t count, bool *results)
+{
+    LS_PROFILER(PK_PHYSICS_LINECAST);
+
+    FRay packet[FBVHTree::RAY_PACKET_SIZE];
+    int numOccluded = 0;
+
+    for (size_t begin = 0; begin < count; begin += FBVHTree::RAY_PACKET_SIZE)
+    {
+        int n = (int)std::min(count - begin, (size_t)FBVHTree::RAY_PACKET_SIZE);
+        for (int i = 0; i < n; ++i)
+        {
+            packet[i] = rays[begin + i];
+            results[begin + i] = false;
+        }
+
+        QueryPacketOcclusion query{ rays + begin, filters + begin, results + begin, FRaycastHit() };
+        staticTree_->queryByRayPacket(packet, n, query);
+
+        // 已经被静态碰撞体阻挡的射线，不需要再查询动态树
+        for (int i = 0; i < n; ++i)
+        {
+            if (results[begin + i])
+            {
+                packet[i].distance = FFloat(0);
+            }
+        }
+        dynamicTree_->queryByRayPacket(packet, n, query);
+
+        for (int i = 0; i < n; ++i)
+        {
+            if (results[begin + i])
+            {
+                ++numOccluded;
+            }
+        }
+    }
+    return numOccluded;
+}
+
+
+class QueryColliderByCollider
+{
+    FGJK *gjk;
+    FCollider *collider;
+    FCollisionInfo info;
+    bool all;
+public:
+    std::vector<FCollider*> targets;
+
+    QueryColliderByCollider(FGJK *_gjk, FCollider *_collider, bool _all)
+        : gjk(_gjk)
+        , collider(_collider)
+        , all(_all)
+    {
+    }
+
+    bool operator()(FBVHNode *node)
+    {
+        // 不同碰撞体之间不能沿用support顶点
+        info.supportA = info.supportB = -1;
+        if (collider->canCollideWith(node->collider.get()) &&
+            overlapTest(gjk, collider, node->collider.get(), info))
+        {
+            targets.push_back(collider != info.a ? info.a : info.b);
+            return !all;
+        }
+        return false;
+    }
+};
+
+FCollider* FPhysics2D::colliderCast(FCollider *collider)
+{
+    return colliderCast(collider, *queryContext_);
+}
+
+FCollider* FPhysics2D::colliderCast(FCollider *collider, FQueryContext &context) const
+{
+    QueryColliderByCollider query(context.getGJK(), collider, false);
+    if (dynamicTree_->queryCollider(collider->getBounds(), query, context.getStack()))
+    {
+        return query.targets[0];
+    }
+
+    if (staticTree_->queryCollider(collider->getBounds(), query, context.getStack()))
+    {
+        return query.targets[0];
+    }
+
+    return nullptr;
+}
+
+bool FPhysics2D::colliderCastAll(FCollider *collider, std::vector<FCollider*> &targets)
+{
+    QueryColliderByCollider query(gjk_, collider, true);
+    dynamicTree_->queryCollider(collider->getBounds(), query);
+    staticTree_->queryCollider(collider->getBounds(), query);
+    targets.swap(query.targets);
+    return !targets.empty();
+}
+
+void FPhysics2D::addRigidbody(FRigidbody * rigidbody)
+{
+    if (rigidbody->isInPhysics())
+    {
+        return;
+    }
+
+    if (rigidbody->getPhysics() == nullptr)
+    {
+        rigidbody->setPhysics(this);
+    }
+    else if (rigidbody->getPhysics() != this)
+    {
+        LOG_ERROR("Rigidbody not created by this physics");
+        return;
+    }
+
+    rigidbodys_.push_back(rigidbody);
+    rigidbody->onAddToPhysicsWorld();
+}
+
+void FPhysics2D::removeRigidbody(FRigidbody * rigidbody)
+{
+    if (!rigidbody->isInPhysics())
+    {
+        return;
+    }
+
+    if (rigidbody->getPhysics() != this)
+    {
+        LOG_ERROR("Rigidbody not created by this physics");
+        return;
     }
 
     if (rigidbody->isActive())
     {
-        activeBodies_.erase(rigidbody->getID());
+        activeBodies_.erase(rigidbody->getID());
+    }
+
+    rigidbody->onRemoveFromPhysicsWorld();
+
+    rigidbodys_.erase(
+        std::remove(rigidbodys_.begin(), rigidbodys_.end(), rigidbody),
+        rigidbodys_.end()
+    );
+}
+
+void FPhysics2D::genCollision(Collision& collision, FCollider* collider)
+{
+    collision.rigidbody = collider->getRigidbody();
+}
+
+void FPhysics2D::addActiveRigidbody(FRigidbody * rigidbody)
+{
+    activeBodies_[rigidbody->getID()] = rigidbody;
+}
+
+void FPhysics2D::addCollider(FCollider *collider)
+{
+    if (collider->bInPhysics_)
+    {
+        return;
+    }
+    collider->bInPhysics_ = true;
+    
+    if (collider->getPhysics() == nullptr)
+    {
+        collider->setPhysics(this);
+    }
+
+    collider->updateTransform();
+
+    if (collider->rigidbody_->isStatic())
+    {
+        staticTree_->addCollider(collider);
+    }
+    else
+    {
+        dynamicTree_->addCollider(collider);
+    }
+}
+
+void FPhysics2D::removeCollider(FCollider *collider)
+{
+    if (!collider->bInPhysics_)
+    {
+        return;
+    }
+    
+    collider->bInPhysics_ = false;
+    if (collider->rigidbody_->isStatic())
+    {
+        staticTree_->removeCollider(collider);
+    }
+    else
+    {
+        dynamicTree_->removeCollider(collider);
+    }
+}
+
+bool FPhysics2D::existColliderPair(FCollider *a, FCollider *b)
+{
+    FColliderPair *pair = findColliderPair(a, b);
+    return pair != nullptr && pair->stamp == tickStamp;
+}
+
+FColliderPair* FPhysics2D::findColliderPair(FCollider *a, FCollider *b)
+{
+    if (a->getID() > b->getID())
+    {
+        std::swap(a, b);
+    }
+
+    uint64_t id = uint64_t(a->getID()) << 32 | uint64_t(b->getID());
+    auto it = colliderPairs_.find(id);
+    return it != colliderPairs_.end() ? &it->second : nullptr;
+}
+
+void FPhysics2D::addColliderPair(const FCollisionInfo &info)
+{
+    FCollisionInfo contact = info;
+    if (contact.a->getID() > contact.b->getID())
+    {
+        swapCollisionInfo(contact);
+    }
+
+    FCollider *a = contact.a;
+    FCollider *b = contact.b;
+    
+    uint64_t id = uint64_t(a->getID()) << 32 | uint64_t(b->getID());
+
+    auto it = colliderPairs_.find(id);
+    if (it != colliderPairs_.end())
+    {
+        FColliderPair &pair = it->second;
+        // 避免重复添加
+        if (pair.stamp == tickStamp)
+        {
+            return;
+        }
+
+        pair.stamp = tickStamp;
+        pair.isTrigger = isTriggerPair(a, b);
+
+        // 按特征id匹配上一帧的接触点，继承累积的分离力，用于预热求解
+        FCollisionInfo &o = pair.collisionInfo;
+        for (int i = 0; i < contact.pointCount; ++i)
+        {
+            FContactPoint &cp = contact.points[i];
+            for (int k = 0; k < o.pointCount; ++k)
+            {
+                if (o.points[k].id == cp.id)
+                {
+                    cp.forceNormal = o.points[k].forceNormal;
+                    cp.forceTangent = o.points[k].forceTangent;
+                    break;
+                }
+            }
+        }
+        o = contact;
+    }
+    else
+    {
+        FColliderPair pair;
+        pair.id = id;
+        pair.a = a;
+        pair.b = b;
+        pair.stamp = tickStamp;
+        pair.state = FColliderPair::STATE_ENTER;
+        pair.collisionInfo = contact;
+        pair.isTrigger = isTriggerPair(a, b);
+        colliderPairs_[id] = pair;
+    }
+}
+
+void FPhysics2D::updateColliderPair(FFloat dt, FColliderPair &pair)
+{
+    SmartPtr<FCollider> a = pair.a;
+    SmartPtr<FCollider> b = pair.b;
+
+    if (pair.stamp != tickStamp)
+    {
+        // 两个刚体都在休眠，不会再查询碰撞对。保留碰撞对，醒来后可以继续使用累积的分离力
+        if (!pair.isTrigger && a->isInPhysics() && b->isInPhysics() && isSleepingPair(pair))
+        {
+            pair.stamp = tickStamp;
+        }
+        else
+        {
+            pair.state = FColliderPair::STATE_EXIT;
+        }
+    }
+
+    if (pair.state == FColliderPair::STATE_ENTER)
+    {
+        PHYSICS_VERBOSE("CollisionEnter: %d-%d", a->getID(), b->getID());
+        pair.state = FColliderPair::STATE_STAY;
+        if (!a->getRigidbody()->isStatic())
+        {
+            a->getRigidbody()->setActive(true);
+        }
+        if (!b->getRigidbody()->isStatic())
+        {
+            b->getRigidbody()->setActive(true);
+        }
+
+        /*if (a->gameObject_ != nullptr && (a->filter_.mask & b->filter_.layer) != 0)
+        {
+            a->gameObject_->collisionEnter(genCollision(b.get()));
+        }
+        if (b->gameObject_ != nullptr && (b->filter_.mask & a->filter_.layer) != 0)
+        {
+            b->gameObject_->collisionEnter(genCollision(a.get()));
+        }*/
+    }
+    else if (pair.state == FColliderPair::STATE_EXIT)
+    {
+        PHYSICS_VERBOSE("CollisionExit: %d-%d", a->getID(), b->getID());
+        /*if (a->gameObject_ != nullptr && (a->filter_.mask & b->filter_.layer) != 0)
+        {
+            a->gameObject_->collisionExit(genCollision(b.get()));
+        }
+        if (b->gameObject_ != nullptr && (b->filter_.mask & a->filter_.layer) != 0)
+        {
+            b->gameObject_->collisionExit(genCollision(a.get()));
+        }*/
+    }
+
+    if (pair.state == FColliderPair::STATE_STAY)
+    {
+        PHYSICS_VERBOSE("CollisionStay: %d-%d, distance: %d, normal: (%d, %d)",
+            a->getID(), b->getID(), toi(pair.collisionInfo.distance),
+            toi(pair.collisionInfo.normal.x),
+            toi(pair.collisionInfo.normal.y));
+
+        /*if (a->gameObject_ != nullptr && (a->filter_.mask & b->filter_.layer) != 0)
+        {
+            a->gameObject_->collisionStay(genCollision(b.get()));
+        }
+        if (b->gameObject_ != nullptr && (b->filter_.mask & a->filter_.layer) != 0)
+        {
+            b->gameObject_->collisionStay(genCollision(a.get()));
+        }*/
+
+        // 触发器需要保持active状态，避免进入idle状态后，发生离开触发器的现象
+        if (pair.isTrigger)
+        {
+            a->rigidbody_->setCollisionStamp(tickStamp);
+            b->rigidbody_->setCollisionStamp(tickStamp);
+        }
+    }
+}
+
+void FPhysics2D::onColliderBBChange(FCollider * collider)
+{
+    if (!enableHandle_)
+    {
+        return;
+    }
+
+    auto tree = collider->rigidbody_->isStatic() ? staticTree_ : dynamicTree_;
+    tree->updateCollider(collider);
+}
+
+void FPhysics2D::onColliderLayerChange(FCollider *collider)
+{
+    if (!enableHandle_)
+    {
+        return;
+    }
+
+    if (collider->rigidbody_->isStatic())
+    {
+        onStaticShapeChange();
+    }
+
+    auto tree = collider->rigidbody_->isStatic() ? staticTree_ : dynamicTree_;
+    tree->updateColliderLayer(collider);
+}
+
+/** 扇形查询。碰撞体的包围盒中心在扇形内即命中 */
+class QuerySectorColliders
+{
+public:
+    FVector2 origin;
+    FVector2 forward;
+    FFloat radius;
+    /** 半角的余弦 */
+    FFloat cosHalfAngle;
+    const FColliderFilter &filter;
+    std::vector<FCollider*> &candidates;
+    /** 候选数量达到capacity后终止查询。需要视线检测时不能提前终止 */
+    size_t capacity;
+
+    QuerySectorColliders(const FVector2 &_origin, const FVector2 &_forward, FFloat _radius, FFloat halfAngle,
+        const FColliderFilter &_filter, std::vector<FCollider*> &_candidates, size_t _capacity)
+        : origin(_origin)
+        , forward(_forward)
+        , radius(_radius)
+        , cosHalfAngle(FMath::cos(halfAngle))
+        , filter(_filter)
+        , candidates(_candidates)
+        , capacity(_capacity)
+    {
+    }
+
+    bool operator()(FBVHNode *node)
+    {
+        FCollider *other = node->collider.get();
+        if (other->isTrigger() || !filter.canCollide(other->getFilter()))
+        {
+            return false;
+        }
+
+        FVector2 delta = other->getBounds().getCenter() - origin;
+        FFloat length = delta.length();
+        if (length > radius || delta.dot(forward) < length * cosHalfAngle)
+        {
+            return false;
+        }
+
+        candidates.push_back(other);
+        return candidates.size() >= capacity;
+    }
+};
+
+int FPhysics2D::overlapSector(const FVector3 &origin, const FVector3 &forward, FFloat radius, FFloat angle, const FColliderFilter &filter,
+    FCollider **results, int capacity, int flags, const FColliderFilter *occluderFilter)
+{
+    LS_PROFILER(PK_PHYSICS_COLLIDERCAST);
+
+    FVector2 direction = forward.toXZ();
+    if (capacity <= 0 || direction.isZero())
+    {
+        return 0;
+    }
+    direction.normalize();
+
+    FFloat halfAngle = FMath::clamp(angle, FFloat(0), FFloat(360)) / 2;
+    FVector2 center = origin.toXZ();
+
+    sectorCandidates_.clear();
+    size_t maxCandidates = occluderFilter ? std::numeric_limits<size_t>::max() : size_t(capacity);
+    QuerySectorColliders query(center, direction, radius, halfAngle, filter, sectorCandidates_, maxCandidates);
+    if (flags & FQ_DYNAMIC)
+    {
+        dynamicTree_->queryBySector(center, direction, radius, halfAngle, query);
+    }
+    if ((flags & FQ_STATIC) && sectorCandidates_.size() < maxCandidates)
+    {
+        staticTree_->queryBySector(center, direction, radius, halfAngle, query);
+    }
+
+    int count = 0;
+    for (FCollider *collider : sectorCandidates_)
+    {
+        if (count >= capacity)
+        {
+            break;
+        }
+
+        if (occluderFilter)
+        {
+            FRay ray(center, collider->getBounds().getCenter());
+            if (ray.distance > 0)
+            {
+                QueryOcclusionByRay occlusion(ray, *occluderFilter);
+                occlusion.ignore = collider;
+                if (staticTree_->queryAnyByRay(ray.start, ray.end, occlusion))
+                {
+                    continue;
+                }
+            }
+        }
+        results[count++] = collider;
+    }
+    return count;
+}
+
+int FPhysics2D::countColliders(const FVector3 &min, const FVector3 &max, uint32_t layerMask, int flags)
+{
+    LS_PROFILER(PK_PHYSICS_COLLIDERCAST);
+
+    FBB bounds;
+    bounds.resetWithPoint(min.toXZ(), max.toXZ());
+
+    int count = 0;
+    if (flags & FQ_DYNAMIC)
+    {
+        count += dynamicTree_->countColliders(bounds, layerMask);
+    }
+    if (flags & FQ_STATIC)
+    {
+        count += staticTree_->countColliders(bounds, layerMask);
+    }
+    return count;
+}
+
+uint32_t FPhysics2D::allocateID()
+{
+    ++idCounter;
+    if (idCounter == 0)
+    {
+        idCounter = 1;
+        LOG_ERROR("id was overflow!");
+    }
+    return idCounter;
+}
+
+void FPhysics2D::doPreSeperation(FFloat dt, FColliderPair & collision)
+{
+    FRigidbody &a = *(collision.a->getRigidbody());
+    FRigidbody &b = *(collision.b->getRigidbody());
+
+    FCollisionInfo &info = collision.collisionInfo;
+
+    FVector3 normal = info.normal;
+    FVector3 tangent(-normal.z, FFloat(0), normal.x);
+
+    for (int i = 0; i < info.pointCount; ++i)
+    {
+        FContactPoint &cp = info.points[i];
+
+        FFloat kNormal = a.getPointMoment(cp.pointA, normal) + b.getPointMoment(cp.pointB, normal);
+        cp.massNormal = FFloat(1) / kNormal;
+
+        FFloat kTangent = a.getPointMoment(cp.pointA, tangent) + b.getPointMoment(cp.pointB, tangent);
+        cp.massTangent = FFloat(1) / kTangent;
+
+        cp.bias = biasFactor_ * FMath::max(FFloat(0), cp.distance - allowedPenetration_) / dt;
+
+        FVector3 F = normal * cp.forceNormal + tangent * cp.forceTangent;
+        a.applyImpulse(-F);
+        a.applyTorqueImpulse(cp.pointA, -F);
+
+        b.applyImpulse(F);
+        b.applyTorqueImpulse(cp.pointB, F);
+
+        PHYSICS_VERBOSE("PreSeperation: %d-%d, point: %d, penetrate: %d, bias: %d, impulse(%d, %d)",
+            collision.a->getID(), collision.b->getID(), i, toi(cp.distance), toi(cp.bias), toi(F.x), toi(F.y));
+    }
+}
+
+FFloat FPhysics2D::doPostSeperation(FFloat dt, FColliderPair &collision)
+{
+    FFloat maxDelta;
+
+    FRigidbody &a = *(collision.a->getRigidbody());
+    FRigidbody &b = *(collision.b->getRigidbody());
+
+    FCollisionInfo &info = collision.collisionInfo;
+    FFloat fraction = FFloat(1) - (info.a->getFriction() + info.a->getFriction()) / 2;
+
+    FVector3 normal = info.normal;
+    FVector3 tangent(-normal.z, FFloat(0), normal.x);
+
+    for (int i = 0; i < info.pointCount; ++i)
+    {
+        FContactPoint &contact = info.points[i];
+
+        // 计算分离力
+        FVector3 relativeVelocity = a.getPointVelocity(contact.pointA) - b.getPointVelocity(contact.pointB);
+
+        FFloat vn = relativeVelocity.dot(normal);
+        FFloat dFn = (vn + contact.bias) * contact.massNormal;
+        FFloat oldFn = contact.forceNormal;
+        // 限制一个最大的力，避免越界
+        contact.forceNormal = FMath::clamp(oldFn + dFn, FFloat(0), FFloat(1000));
+        dFn = contact.forceNormal - oldFn;
+        maxDelta = FMath::max(maxDelta, FMath::abs(dFn));
+
+        FVector3 F = normal * dFn;
+        a.applyImpulse(-F);
+        a.applyTorqueImpulse(contact.pointA, -F);
+
+        b.applyImpulse(F);
+        b.applyTorqueImpulse(contact.pointB, F);
+
+        PHYSICS_VERBOSE("doPostSeperation-normal: %d-%d, point: %d, impulse(%d, %d), accumulate: %d, rv(%d, %d) v1(%d, %d), v2(%d, %d)",
+            collision.a->getID(), collision.b->getID(), i, toi(F.x), toi(F.y),
+            toi(contact.forceNormal),
+            toi(relativeVelocity.x), toi(relativeVelocity.y),
+            toi(a.velocity.x), toi(a.velocity.y),
+            toi(b.velocity.x), toi(b.velocity.y));
+
+        // 计算摩擦力
+        relativeVelocity = a.getPointVelocity(contact.pointA) - b.getPointVelocity(contact.pointB);
+
+        FFloat vt = relativeVelocity.dot(tangent);
+        FFloat dFt = vt * contact.massTangent;
+        FFloat maxFt = fraction * contact.forceNormal;
+        FFloat oldFt = contact.forceTangent;
+        contact.forceTangent = FMath::clamp(oldFt + dFt, -maxFt, maxFt);
+        dFt = contact.forceTangent - oldFt;
+        maxDelta = FMath::max(maxDelta, FMath::abs(dFt));
+
+        F = tangent * dFt;
+        a.applyImpulse(-F);
+        a.applyTorqueImpulse(contact.pointA, -F);
+
+        b.applyImpulse(F);
+        b.applyTorqueImpulse(contact.pointB, F);
+
+        PHYSICS_VERBOSE("doPostSeperation-tangent: %d-%d, point: %d, impulse(%d, %d), accumulate: %d, v(%d, %d)",
+            collision.a->getID(), collision.b->getID(), i, toi(F.x), toi(F.y),
+            toi(contact.forceTangent),
+            toi(relativeVelocity.x), toi(relativeVelocity.y));
+    }
+    return maxDelta;
+}
+
+void FPhysics2D::doSubstepPreSeperation(FFloat dt, FColliderPair &collision)
+{
+    FRigidbody &a = *(collision.a->getRigidbody());
+    FRigidbody &b = *(collision.b->getRigidbody());
+
+    FCollisionInfo &info = collision.collisionInfo;
+
+    FVector3 normal = info.normal;
+    FVector3 tangent(-normal.z, FFloat(0), normal.x);
+
+    for (int i = 0; i < info.pointCount; ++i)
+    {
+        FContactPoint &cp = info.points[i];
+
+        // 子步中位置保持不变，接触点的位移由刚体的累积位移和旋转线性估算
+        FVector3 rA = cp.pointA - a.position;
+        FVector3 rB = cp.pointB - b.position;
+        FVector3 moveA = a.substepVelocity_ + FVector3(-rA.z, FFloat(0), rA.x) * a.substepAngleVelocity_ * FMath::DEGREE_RADIAN;
+        FVector3 moveB = b.substepVelocity_ + FVector3(-rB.z, FFloat(0), rB.x) * b.substepAngleVelocity_ * FMath::DEGREE_RADIAN;
+
+        FFloat distance = cp.distance - (moveB - moveA).dot(normal) * dt;
+        cp.bias = biasFactor_ * FMath::max(FFloat(0), distance - allowedPenetration_) / dt;
+
+        // 累积冲量是单个子步的冲量，每个子步都需要重新应用
+        FVector3 F = normal * cp.forceNormal + tangent * cp.forceTangent;
+        a.applyImpulse(-F);
+        a.applyTorqueImpulse(cp.pointA, -F);
+
+        b.applyImpulse(F);
+        b.applyTorqueImpulse(cp.pointB, F);
+    }
+}
+
+void FPhysics2D::solveSubsteps(FFloat dt)
+{
+    FFloat stepTime = dt / solverSubsteps_;
+
+    LS_PROFILER_BEGIN(PK_PHYSICS_PRE_SEPERATION);
+    for (auto &pair : colliderPairs_)
+    {
+        if (!pair.second.isTrigger && !isSleepingPair(pair.second))
+        {
+            doPreSeperation(stepTime, pair.second);
+        }
+    }
+    LS_PROFILER_END(PK_PHYSICS_PRE_SEPERATION);
+
+    LS_PROFILER_BEGIN(PK_PHYSICS_POST_SEPERATION);
+    for (int i = 0; i < solverSubsteps_; ++i)
+    {
+        // 第一个子步的速度已经在tick开始时更新过了
+        if (i > 0)
+        {
+            for (auto &pair : activeBodies_)
+            {
+                pair.second->updateSubstep(stepTime);
+            }
+
+            for (auto &pair : colliderPairs_)
+            {
+                if (!pair.second.isTrigger && !isSleepingPair(pair.second))
+                {
+                    doSubstepPreSeperation(stepTime, pair.second);
+                }
+            }
+        }
+
+        for (auto &pair : colliderPairs_)
+        {
+            if (!pair.second.isTrigger && !isSleepingPair(pair.second))
+            {
+                doPostSeperation(stepTime, pair.second);
+            }
+        }
+
+        for (auto &pair : activeBodies_)
+        {
+            pair.second->integrateSubstep();
+        }
+    }
+
+    // 穿透修正只作用于位移，最后再迭代一次去掉偏置速度，避免额外的动能
+    for (auto &pair : colliderPairs_)
+    {
+        if (!pair.second.isTrigger && !isSleepingPair(pair.second))
+        {
+            FCollisionInfo &info = pair.second.collisionInfo;
+            for (int i = 0; i < info.pointCount; ++i)
+            {
+                info.points[i].bias = FFloat(0);
+            }
+            doPostSeperation(stepTime, pair.second);
+        }
+    }
+    LS_PROFILER_END(PK_PHYSICS_POST_SEPERATION);
+
+    lastIteration_ = solverSubsteps_ + 1;
+}
+
+/** 撞击时间查询停在距离目标这么远的地方。GJK在距离很近时会判定为相交，需要在此之前停下 */
+static const FFloat TOI_TARGET_DISTANCE = FFloat(0, 0, 4);
+/** 保守前进法的最大迭代次数 */
+static const int TOI_MAX_STEPS = 10;
+/** 每帧最多处理的撞击次数。撞击后沿切线方向的位移可能会撞到别的碰撞体 */
+static const int CCD_MAX_HITS = 3;
+
+/** 分离轴细化的迭代次数 */
+static const int TOI_AXIS_STEPS = 8;
+
+/** a平移offset之后，与b沿方向n的投影间距。对任意方向，它都是两者真实距离的下界 */
+static FFloat computeSeparation(FCollider *a, const FVector2 &offset, FCollider *b, const FVector2 &n)
+{
+    return (b->getFarthestPointInDirection(-n) - a->getFarthestPointInDirection(n) - offset).dot(n);
+}
+
+/** 在n附近寻找投影间距最大的方向。投影间距在分离方向附近是单峰的，用三分法查找。
+ *  GJK的最近点受定点数精度影响，距离很近时方向误差较大，细长的碰撞体会因此得到很小的下界。
+ */
+static FFloat refineSeparatingAxis(FCollider *a, const FVector2 &offset, FCollider *b, FVector2 &n)
+{
+    FVector2 perp(-n.y, n.x);
+    FFloat lo = -FFloat(0, 5);
+    FFloat hi = FFloat(0, 5);
+    for (int i = 0; i < TOI_AXIS_STEPS; ++i)
+    {
+        FFloat m1 = lo + (hi - lo) / 3;
+        FFloat m2 = hi - (hi - lo) / 3;
+
+        FVector2 n1 = n + perp * m1;
+        FVector2 n2 = n + perp * m2;
+        n1.normalize();
+        n2.normalize();
+
+        if (computeSeparation(a, offset, b, n1) < computeSeparation(a, offset, b, n2))
+        {
+            lo = m1;
+        }
+        else
+        {
+            hi = m2;
+        }
+    }
+
+    FVector2 best = n + perp * ((lo + hi) / 2);
+    best.normalize();
+
+    FFloat distance = computeSeparation(a, offset, b, n);
+    FFloat refined = computeSeparation(a, offset, b, best);
+    if (refined > distance)
+    {
+        n = best;
+        return refined;
+    }
+    return distance;
+}
+
+/** 保守前进法计算a沿direction平移时撞到b的距离，只考虑平移，不考虑旋转。
+ *  撞击时gjk->closestOnB是b上的撞击点。
+ *  @param direction    单位化的平移方向
+ *  @param maxDistance  平移的最大距离
+ *  @param normal       撞击的法线，从a指向b
+ *  @param overlapped   一开始就相交时为true，此时返回0
+ *  @return 撞击前移动的距离，不会撞击时返回maxDistance
+ */
+static FFloat computeTimeOfImpact(FGJK *gjk, FCollider *a, FCollider *b, const FVector2 &direction, FFloat maxDistance,
+    FVector2 &normal, bool &overlapped)
+{
+    overlapped = false;
+
+    FFloat travel = 0;
+    for (int i = 0; i < TOI_MAX_STEPS; ++i)
+    {
+        FVector2 offset = direction * travel;
+        if (!gjk->queryDistance(a, offset, b))
+        {
+            overlapped = i == 0;
+            return travel;
+        }
+
+        FVector2 n = gjk->closestOnB - gjk->closestOnA;
+        if (n.isZero())
+        {
+            return travel;
+        }
+        n.normalize();
+
+        // GJK的最近点只用来确定分离方向。沿分离方向的投影间距是真实距离的下界，按它前进不会越过撞击点
+        FFloat distance = refineSeparatingAxis(a, offset, b, n);
+        if (distance <= TOI_TARGET_DISTANCE)
+        {
+            normal = n;
+            return travel;
+        }
+
+        FFloat approach = direction.dot(n);
+        FFloat remain = distance - TOI_TARGET_DISTANCE;
+        if (approach <= 0 || remain >= approach * (maxDistance - travel))
+        {
+            return maxDistance;
+        }
+
+        normal = n;
+        travel += remain / approach;
+    }
+    return travel;
+}
+
+/** 查询最早的撞击 */
+class QueryTimeOfImpact
+{
+public:
+    FGJK *gjk;
+    FCollider *collider;
+    /** 单位化的平移方向 */
+    FVector2 direction;
+    /** 是否报告一开始就相交的碰撞体。连续碰撞检测把它们交给碰撞求解处理 */
+    bool reportOverlap;
+
+    /** 撞击前移动的距离 */
+    FFloat distance;
+    /** 撞击的法线，从collider指向target */
+    FVector2 normal;
+    /** target上的撞击点 */
+    FVector2 point;
+    FCollider *target = nullptr;
+
+    QueryTimeOfImpact(FGJK *_gjk, const FVector2 &motion, bool _reportOverlap)
+        : gjk(_gjk)
+        , collider(nullptr)
+        , direction(motion)
+        , reportOverlap(_reportOverlap)
+    {
+        distance = direction.length();
+        if (distance > 0)
+        {
+            direction /= distance;
+        }
+    }
+
+    bool operator()(FBVHNode *node)
+    {
+        FCollider *other = node->collider.get();
+        if (other->isTrigger() || !collider->canCollideWith(other))
+        {
+            return false;
+        }
+
+        FVector2 n;
+        bool overlapped;
+        FFloat d = computeTimeOfImpact(gjk, collider, other, direction, distance, n, overlapped);
+        if (overlapped && !reportOverlap)
+        {
+            return false;
+        }
+
+        // 距离相同时按id选择，保证结果与遍历顺序无关
+        if (d < distance || (d == distance && target != nullptr && other->getID() < target->getID()))
+        {
+            distance = d;
+            target = other;
+            if (overlapped)
+            {
+                normal = direction;
+                point = collider->getBounds().getCenter();
+            }
+            else
+            {
+                normal = n;
+                point = getImpactPoint(other);
+            }
+        }
+        return false;
+    }
+
+private:
+    /** GJK的最近点对圆形不精确，撞击点由法线和support顶点重新计算。需要在更新distance和normal之后调用 */
+    FVector2 getImpactPoint(FCollider *other) const
+    {
+        if (collider->getType() == FT_CIRCLE)
+        {
+            FCircleCollider *circle = static_cast<FCircleCollider*>(collider);
+            return circle->getWorldCenter() + direction * distance + normal * circle->getWorldRadius();
+        }
+
+        // target以顶点接触时，撞击点就是target沿-normal的support顶点。
+        // 以边接触时，support顶点只是边的端点，可能离撞击点很远，仍使用GJK在边上的最近点
+        FVector2 support = other->getFarthestPointInDirection(-normal);
+        if (support.distanceTo(gjk->closestOnB) <= TOI_TARGET_DISTANCE)
+        {
+            return support;
+        }
+        return gjk->closestOnB;
+    }
+};
+
+void FPhysics2D::solveContinuousCollision(FFloat dt)
+{
+    bool useSubsteps = solverSubsteps_ > 1;
+    FFloat stepTime = useSubsteps ? dt / solverSubsteps_ : dt;
+
+    for (auto &pair : activeBodies_)
+    {
+        FRigidbody *rigidbody = pair.second.get();
+        if (!rigidbody->isDynamic() || !rigidbody->isContinuousCollision())
+        {
+            continue;
+        }
+
+        for (int hit = 0; hit < CCD_MAX_HITS; ++hit)
+        {
+            // 与postUpdate、postSubsteps的位移保持一致
+            FVector3 displacement = useSubsteps ?
+                rigidbody->substepVelocity_ * stepTime + rigidbody->pulseVelocity * dt :
+                (rigidbody->velocity + rigidbody->pulseVelocity) * dt;
+
+            FVector2 motion = displacement.toXZ();
+            if (motion.isZero())
+            {
+                break;
+            }
+
+            QueryTimeOfImpact query(gjk_, motion, false);
+            for (size_t i = 0; i < rigidbody->getNumColliders(); ++i)
+            {
+                FCollider *collider = rigidbody->getCollider(i);
+                if (collider->isTrigger())
+                {
+                    continue;
+                }
+
+                // 位移不超过碰撞体尺寸的一半，离散检测就足够了
+                FBB bounds = collider->getBounds();
+                FVector2 size = bounds.getDiameter();
+                if (motion.length() <= FMath::min(size.x, size.y) / 2)
+                {
+                    continue;
+                }
+
+                bounds.add(FBB(bounds.min + motion, bounds.max + motion));
+
+                query.collider = collider;
+                staticTree_->queryCollider(bounds, query);
+            }
+
+            if (query.target == nullptr)
+            {
+                break;
+            }
+            FFloat distance = query.direction.dot(query.normal) * query.distance;
+            rigidbody->clipMotion(FVector3::FromXZ(query.normal), distance, dt);
+        }
+    }
+}
+
+/** 点到碰撞体表面的距离。probe是位于该点、半径为0的圆，点在碰撞体内部时返回0 */
+static FFloat computePointDistance(FGJK *gjk, FCircleCollider *probe, FCollider *collider)
+{
+    if (collider->getType() == FT_CIRCLE)
+    {
+        FCircleCollider *circle = static_cast<FCircleCollider*>(collider);
+        FFloat distance = probe->getWorldCenter().distanceTo(circle->getWorldCenter()) - circle->getWorldRadius();
+        return FMath::max(distance, FFloat(0));
+    }
+
+    if (!gjk->queryDistance(probe, FVector2::ZERO, collider))
+    {
+        return FFloat(0);
+    }
+    return gjk->closestOnA.distanceTo(gjk->closestOnB);
+}
+
+/** 查询与shape相交的碰撞体，写满缓冲区后停止 */
+class QueryOverlapShape
+{
+public:
+    FCollider *shape;
+    FCollider **results;
+    int capacity;
+    int count = 0;
+    FCollisionInfo info;
+
+    QueryOverlapShape(FCollider *_shape, FCollider **_results, int _capacity)
+        : shape(_shape)
+        , results(_results)
+        , capacity(_capacity)
+    {
+    }
+
+    bool operator()(FBVHNode *node)
+    {
+        FCollider *other = node->collider.get();
+        if (other->isTrigger() || !shape->canCollideWith(other))
+        {
+            return false;
+        }
+
+        // 不同碰撞体之间不能沿用support顶点
+        info.supportA = info.supportB = -1;
+        if (overlapTest(shape, other, info))
+        {
+            results[count++] = other;
+        }
+        return count >= capacity;
+    }
+};
+
+/** 查询与圆相交的碰撞体。圆心处放置半径为0的探针，距离不超过半径即相交 */
+class QueryOverlapCircle
+{
+public:
+    FGJK *gjk;
+    FCircleCollider *probe;
+    FFloat radius;
+    FCollider **results;
+    int capacity;
+    int count = 0;
+
+    QueryOverlapCircle(FGJK *_gjk, FCircleCollider *_probe, FFloat _radius, FCollider **_results, int _capacity)
+        : gjk(_gjk)
+        , probe(_probe)
+        , radius(_radius)
+        , results(_results)
+        , capacity(_capacity)
+    {
+    }
+
+    bool operator()(FBVHNode *node)
+    {
+        FCollider *other = node->collider.get();
+        if (other->isTrigger() || !probe->canCollideWith(other) || other->getBounds().getDistanceToPoint(probe->getWorldCenter()) > radius)
+        {
+            return false;
+        }
+
+        if (computePointDistance(gjk, probe, other) <= radius)
+        {
+            results[count++] = other;
+        }
+        return count >= capacity;
+    }
+};
+
+int FPhysics2D::overlapCircle(const FVector3 &center, FFloat radius, const FColliderFilter &filter,
+    FCollider **results, int capacity, int flags)
+{
+    LS_PROFILER(PK_PHYSICS_COLLIDERCAST);
+
+    if (capacity <= 0)
+    {
+        return 0;
+    }
+
+    // GJK中圆的support点不精确，胖圆会误报。改用半径为0的探针计算点到碰撞体的距离
+    FCircleCollider *probe = static_cast<FCircleCollider*>(castCircle_.get());
+    probe->setRadius(FFloat(0));
+    probe->setFilter(filter);
+
+    castRigidbody_->setBodyPosition(center);
+    castRigidbody_->setBodyAngle(FFloat(0));
+    castRigidbody_->updateTransform();
+
+    QueryOverlapCircle query(gjk_, probe, radius, results, capacity);
+    FBB bounds(probe->getWorldCenter(), radius);
+    if ((flags & FQ_DYNAMIC) && dynamicTree_->queryCollider(bounds, query))
+    {
+        return query.count;
+    }
+    if (flags & FQ_STATIC)
+    {
+        staticTree_->queryCollider(bounds, query);
+    }
+    return query.count;
+}
+
+int FPhysics2D::overlapBox(const FVector3 &center, FFloat width, FFloat height, FFloat angle, const FColliderFilter &filter,
+    FCollider **results, int capacity, int flags)
+{
+    FFloat dx = width / 2;
+    FFloat dy = height / 2;
+    FVector2 verts[] = {
+        {-dx, -dy},
+        {-dx, dy},
+        {dx, dy},
+        {dx, -dy},
+    };
+    static_cast<FPolygonCollider*>(castPolygon_.get())->setVertices(verts, 4, true);
+
+    castRigidbody_->setBodyPosition(center);
+    castRigidbody_->setBodyAngle(angle);
+    castRigidbody_->updateTransform();
+
+    return overlapShape(castPolygon_.get(), filter, results, capacity, flags);
+}
+
+int FPhysics2D::overlapPolygon(const FVector3 *vertices, size_t count, const FColliderFilter &filter,
+    FCollider **results, int capacity, int flags)
+{
+    static_cast<FPolygonCollider*>(castPolygon_.get())->setVertices(vertices, count, true);
+
+    castRigidbody_->setBodyPosition(FVector3::Zero);
+    castRigidbody_->setBodyAngle(FFloat(0));
+    castRigidbody_->updateTransform();
+
+    return overlapShape(castPolygon_.get(), filter, results, capacity, flags);
+}
+
+int FPhysics2D::overlapShape(FCollider *shape, const FColliderFilter &filter, FCollider **results, int capacity, int flags)
+{
+    LS_PROFILER(PK_PHYSICS_COLLIDERCAST);
+
+    if (capacity <= 0)
+    {
+        return 0;
+    }
+
+    shape->setFilter(filter);
+
+    QueryOverlapShape query(shape, results, capacity);
+    if ((flags & FQ_DYNAMIC) && dynamicTree_->queryCollider(shape->getBounds(), query))
+    {
+        return query.count;
+    }
+    if (flags & FQ_STATIC)
+    {
+        staticTree_->queryCollider(shape->getBounds(), query);
+    }
+    return query.count;
+}
+
+/** 查询最近的k个碰撞体。结果按距离排序，距离相同时按id排序 */
+class QueryNearestColliders
+{
+public:
+    FGJK *gjk;
+    FCircleCollider *probe;
+    FCollider **results;
+    FFloat *distances;
+    int k;
+    FFloat maxDistance;
+    int count = 0;
+
+    QueryNearestColliders(FGJK *_gjk, FCircleCollider *_probe, FCollider **_results, FFloat *_distances, int _k, FFloat _maxDistance)
+        : gjk(_gjk)
+        , probe(_probe)
+        , results(_results)
+        , distances(_distances)
+        , k(_k)
+        , maxDistance(_maxDistance)
+    {
+    }
+
+    FFloat operator()(FBVHNode *node)
+    {
+        FCollider *other = node->collider.get();
+        if (other->isTrigger() || !probe->canCollideWith(other) || other->getBounds().getDistanceToPoint(probe->getWorldCenter()) > searchRadius())
+        {
+            return searchRadius();
+        }
+
+        FFloat distance = computePointDistance(gjk, probe, other);
+        if (distance > searchRadius())
+        {
+            return searchRadius();
+        }
+
+        int i;
+        if (count < k)
+        {
+            i = count++;
+        }
+        else if (isCloser(distance, other, k - 1))
+        {
+            // 替换掉最远的
+            i = k - 1;
+        }
+        else
+        {
+            return searchRadius();
+        }
+
+        // 插入排序
+        while (i > 0 && isCloser(distance, other, i - 1))
+        {
+            results[i] = results[i - 1];
+            distances[i] = distances[i - 1];
+            --i;
+        }
+        results[i] = other;
+        distances[i] = distance;
+        return searchRadius();
+    }
+
+    /** 结果满了之后，只需要查找比第k个更近的碰撞体 */
+    FFloat searchRadius() const
+    {
+        return count < k ? maxDistance : distances[k - 1];
+    }
+
+    bool isCloser(FFloat distance, FCollider *collider, int i) const
+    {
+        return distance < distances[i] || (distance == distances[i] && collider->getID() < results[i]->getID());
+    }
+};
+
+int FPhysics2D::queryNearest(const FVector3 &point, int k, FFloat maxDistance, const FColliderFilter &filter,
+    FCollider **results, FFloat *distances, int flags)
+{
+    LS_PROFILER(PK_PHYSICS_COLLIDERCAST);
+
+    if (k <= 0)
+    {
+        return 0;
+    }
+
+    FCircleCollider *probe = static_cast<FCircleCollider*>(castCircle_.get());
+    probe->setRadius(FFloat(0));
+    probe->setFilter(filter);
+
+    castRigidbody_->setBodyPosition(point);
+    castRigidbody_->setBodyAngle(FFloat(0));
+    castRigidbody_->updateTransform();
+
+    if (distances == nullptr)
+    {
+        nearestDistances_.resize(k);
+        distances = nearestDistances_.data();
+    }
+
+    for (int i = 0; i < k; ++i)
+    {
+        results[i] = nullptr;
+    }
+
+    QueryNearestColliders query(gjk_, probe, results, distances, k, maxDistance);
+    if (flags & FQ_DYNAMIC)
+    {
+        dynamicTree_->queryNearest(probe->getWorldCenter(), query.searchRadius(), query);
+    }
+    if (flags & FQ_STATIC)
+    {
+        staticTree_->queryNearest(probe->getWorldCenter(), query.searchRadius(), query);
     }
-
-    rigidbody->onRemoveFromPhysicsWorld();
-
-    rigidbodys_.erase(
-        std::remove(rigidbodys_.begin(), rigidbodys_.end(), rigidbody),
-        rigidbodys_.end()
-    );
+    return query.count;
 }
 
-void FPhysics2D::genCollision(Collision& collision, FCollider* collider)
+FCollider* FPhysics2D::findNearest(const FVector3 &point, FFloat maxDistance, const FColliderFilter &filter, int flags)
 {
-    collision.rigidbody = collider->getRigidbody();
+    FCollider *result = nullptr;
+    FFloat distance;
+    queryNearest(point, 1, maxDistance, filter, &result, &distance, flags);
+    return result;
 }
 
-void FPhysics2D::addActiveRigidbody(FRigidbody * rigidbody)
+/** 两个包围盒之间的距离，相交时为0 */
+static FFloat getBBDistance(const FBB &a, const FBB &b)
 {
-    activeBodies_[rigidbody->getID()] = rigidbody;
+    FVector2 delta(
+        FMath::max(FMath::max(a.min.x - b.max.x, b.min.x - a.max.x), FFloat(0)),
+        FMath::max(FMath::max(a.min.y - b.max.y, b.min.y - a.max.y), FFloat(0)));
+    return delta.length();
 }
 
-void FPhysics2D::addCollider(FCollider *collider)
+/** 两个碰撞体表面之间的距离，相交时返回0。pointOnB是b上的最近点，normal从b指向a，相交时为0。
+ *  圆形先缩小成圆心处半径为0的探针，求出距离后再减去半径，比直接对圆形做GJK更精确
+ */
+static FFloat computeColliderDistance(FGJK *gjk, FCircleCollider *probe, FCollider *a, FCollider *b,
+    FVector2 &pointOnB, FVector2 &normal)
 {
-    if (collider->bInPhysics_)
+    normal = FVector2::ZERO;
+
+    if (a->getType() == FT_CIRCLE && b->getType() == FT_CIRCLE)
     {
-        return;
+        FCircleCollider *circleA = static_cast<FCircleCollider*>(a);
+        FCircleCollider *circleB = static_cast<FCircleCollider*>(b);
+
+        FVector2 delta = circleA->getWorldCenter() - circleB->getWorldCenter();
+        FFloat length = delta.length();
+        if (length > FFloat(0))
+        {
+            normal = delta / length;
+        }
+        pointOnB = circleB->getWorldCenter() + normal * circleB->getWorldRadius();
+        return FMath::max(length - circleA->getWorldRadius() - circleB->getWorldRadius(), FFloat(0));
     }
-    collider->bInPhysics_ = true;
-    
-    if (collider->getPhysics() == nullptr)
+
+    FFloat radiusA = 0;
+    FFloat radiusB = 0;
+    FCircleCollider *circle = nullptr;
+    if (a->getType() == FT_CIRCLE)
     {
-        collider->setPhysics(this);
+        circle = static_cast<FCircleCollider*>(a);
+        radiusA = circle->getWorldRadius();
+        a = probe;
+    }
+    else if (b->getType() == FT_CIRCLE)
+    {
+        circle = static_cast<FCircleCollider*>(b);
+        radiusB = circle->getWorldRadius();
+        b = probe;
     }
 
-    collider->updateTransform();
+    if (circle != nullptr)
+    {
+        FVector3 center;
+        center.setXZ(circle->getWorldCenter());
+        probe->setRadius(FFloat(0));
+        probe->getRigidbody()->setBodyPosition(center);
+        probe->getRigidbody()->setBodyAngle(FFloat(0));
+        probe->getRigidbody()->updateTransform();
+    }
 
-    if (collider->rigidbody_->isStatic())
+    if (!gjk->queryDistance(a, FVector2::ZERO, b))
     {
-        staticTree_->addCollider(collider);
+        pointOnB = a->getBounds().getCenter();
+        return FFloat(0);
     }
-    else
+
+    FVector2 delta = gjk->closestOnA - gjk->closestOnB;
+    FFloat length = delta.length();
+    if (length > FFloat(0))
     {
-        dynamicTree_->addCollider(collider);
+        normal = delta / length;
     }
+    pointOnB = gjk->closestOnB + normal * radiusB;
+    return FMath::max(length - radiusA - radiusB, FFloat(0));
 }
 
-void FPhysics2D::removeCollider(FCollider *collider)
+/** 查询离collider最近的碰撞体。距离相同时选择id较小的 */
+class QueryNearestDistance
 {
-    if (!collider->bInPhysics_)
+public:
+    FGJK *gjk;
+    FCircleCollider *probe;
+    FCollider *collider;
+    const FColliderFilter &filter;
+    /** collider包围盒的外接圆半径。BVH以包围盒中心查询，需要扩大搜索半径 */
+    FFloat extent;
+    FFloat distance;
+    FCollider *nearest = nullptr;
+    FVector2 point;
+    FVector2 normal;
+
+    QueryNearestDistance(FGJK *_gjk, FCircleCollider *_probe, FCollider *_collider, const FColliderFilter &_filter, FFloat maxDistance)
+        : gjk(_gjk)
+        , probe(_probe)
+        , collider(_collider)
+        , filter(_filter)
+        , distance(maxDistance)
     {
-        return;
+        const FBB &bb = collider->getBounds();
+        extent = (bb.max - bb.min).length() / 2;
     }
-    
-    collider->bInPhysics_ = false;
-    if (collider->rigidbody_->isStatic())
+
+    FFloat operator()(FBVHNode *node)
     {
-        staticTree_->removeCollider(collider);
+        FCollider *other = node->collider.get();
+        if (other == collider || other->getRigidbody() == collider->getRigidbody() || other->isTrigger() ||
+            !filter.canCollide(other->getFilter()) ||
+            getBBDistance(collider->getBounds(), other->getBounds()) > distance)
+        {
+            return searchRadius();
+        }
+
+        FVector2 tempPoint, tempNormal;
+        FFloat d = computeColliderDistance(gjk, probe, collider, other, tempPoint, tempNormal);
+        if (nearest == nullptr ? d <= distance : (d < distance || (d == distance && other->getID() < nearest->getID())))
+        {
+            nearest = other;
+            distance = d;
+            point = tempPoint;
+            normal = tempNormal;
+        }
+        return searchRadius();
     }
-    else
+
+    FFloat searchRadius() const
     {
-        dynamicTree_->removeCollider(collider);
+        return distance + extent;
     }
+};
+
+FFloat FPhysics2D::distance(FCollider *colliderA, FCollider *colliderB)
+{
+    FVector2 point, normal;
+    FCircleCollider *probe = static_cast<FCircleCollider*>(castCircle_.get());
+    return computeColliderDistance(gjk_, probe, colliderA, colliderB, point, normal);
 }
 
-bool FPhysics2D::existColliderPair(FCollider *a, FCollider *b)
+bool FPhysics2D::distanceToNearest(FCollider *collider, const FColliderFilter &filter, FFloat maxDistance, FRaycastHit &hit, int flags)
 {
-    if (a->getID() > b->getID())
+    LS_PROFILER(PK_PHYSICS_COLLIDERCAST);
+
+    FCircleCollider *probe = static_cast<FCircleCollider*>(castCircle_.get());
+    QueryNearestDistance query(gjk_, probe, collider, filter, maxDistance);
+
+    FVector2 center = collider->getBounds().getCenter();
+    if (flags & FQ_DYNAMIC)
     {
-        std::swap(a, b);
+        dynamicTree_->queryNearest(center, query.searchRadius(), query);
+    }
+    if (flags & FQ_STATIC)
+    {
+        staticTree_->queryNearest(center, query.searchRadius(), query);
     }
 
-    uint64_t id = uint64_t(a->getID()) << 32 | uint64_t(b->getID());
-    auto it = colliderPairs_.find(id);
-    return it != colliderPairs_.end() && it->second.stamp == tickStamp;
+    hit.collider = query.nearest;
+    if (query.nearest == nullptr)
+    {
+        return false;
+    }
+
+    hit.distance = query.distance;
+    hit.point.setXZ(query.point);
+    hit.normal.setXZ(query.normal);
+    return true;
 }
 
-void FPhysics2D::addColliderPair(const FCollisionInfo &info)
+int FPhysics2D::distanceToNearestBatch(FCollider *const *colliders, size_t count, const FColliderFilter &filter, FFloat maxDistance,
+    FRaycastHit *hits, int flags)
 {
-    FCollisionInfo contact = info;
-    if (contact.a->getID() > contact.b->getID())
+    int n = 0;
+    for (size_t i = 0; i < count; ++i)
     {
-        swapCollisionInfo(contact);
+        if (distanceToNearest(colliders[i], filter, maxDistance, hits[i], flags))
+        {
+            ++n;
+        }
     }
+    return n;
+}
 
-    FCollider *a = contact.a;
-    FCollider *b = contact.b;
-    
-    uint64_t id = uint64_t(a->getID()) << 32 | uint64_t(b->getID());
+bool FPhysics2D::circleCast(const FVector3 &start, const FVector3 &end, FFloat radius, const FColliderFilter &filter, FRaycastHit &hit)
+{
+    FCircleCollider *circle = static_cast<FCircleCollider*>(castCircle_.get());
+    circle->setRadius(radius);
+    circle->setFilter(filter);
 
-    auto it = colliderPairs_.find(id);
-    if (it != colliderPairs_.end())
+    castRigidbody_->setBodyPosition(start);
+    castRigidbody_->setBodyAngle(FFloat(0));
+    castRigidbody_->updateTransform();
+
+    return sweepCollider(circle, (end - start).toXZ(), hit);
+}
+
+bool FPhysics2D::colliderCast(FCollider *collider, const FVector3 &motion, FRaycastHit &hit)
+{
+    return sweepCollider(collider, motion.toXZ(), hit);
+}
+
+bool FPhysics2D::sweepCollider(FCollider *collider, const FVector2 &motion, FRaycastHit &hit)
+{
+    LS_PROFILER(PK_PHYSICS_COLLIDERCAST);
+
+    // 用扫掠区域的包围盒查询候选碰撞体，再逐个计算撞击时间
+    FBB bounds = collider->getBounds();
+    bounds.add(FBB(bounds.min + motion, bounds.max + motion));
+
+    QueryTimeOfImpact query(gjk_, motion, true);
+    query.collider = collider;
+    dynamicTree_->queryCollider(bounds, query);
+    staticTree_->queryCollider(bounds, query);
+
+    if (query.target == nullptr)
     {
-        FColliderPair &pair = it->second;
-        // 避免重复添加
-        if (pair.stamp == tickStamp)
-        {
-            return;
-        }
+        return false;
+    }
 
-        pair.stamp = tickStamp;
-        pair.isTrigger = a->isTrigger() || b->isTrigger() ||
-            a->getRigidbody()->isKinematic() || b->getRigidbody()->isKinematic();
+    hit.collider = query.target;
+    hit.point = FVector3::FromXZ(query.point);
+    hit.normal = FVector3::FromXZ(-query.normal);
+    hit.distance = query.distance;
+    return true;
+}
 
-        FCollisionInfo &o = pair.collisionInfo;
-        o.a = contact.a;
-        o.b = contact.b;
-        o.distance = contact.distance;
-        o.normal = contact.normal;
-        o.pointA = contact.pointA;
-        o.pointB = contact.pointB;
+void FPhysics2D::setSolverThreadCount(int count)
+{
+    if (count < 0)
+    {
+        count = 0;
     }
-    else
+    if (count == solverThreadCount_)
     {
-        FColliderPair pair;
-        pair.id = id;
-        pair.a = a;
-        pair.b = b;
-        pair.stamp = tickStamp;
-        pair.state = FColliderPair::STATE_ENTER;
-        pair.collisionInfo = contact;
-        pair.isTrigger = a->isTrigger() || b->isTrigger() ||
-            a->getRigidbody()->isKinematic() || b->getRigidbody()->isKinematic();
-        colliderPairs_[id] = pair;
+        return;
     }
+
+    solverThreadCount_ = count;
+
+    delete threadPool_;
+    threadPool_ = count > 1 ? new FThreadPool(count) : nullptr;
 }
 
-void FPhysics2D::updateColliderPair(FFloat dt, FColliderPair &pair)
+void FPhysics2D::colorColliderPairs()
 {
-    SmartPtr<FCollider> a = pair.a;
-    SmartPtr<FCollider> b = pair.b;
+    solverPairs_.clear();
+    colorOffsets_.assign(MAX_SOLVER_COLORS + 2, 0);
+    pairColors_.clear();
 
-    if (pair.stamp != tickStamp)
+    for (auto &pair : colliderPairs_)
     {
-        pair.state = FColliderPair::STATE_EXIT;
+        FColliderPair &collision = pair.second;
+        if (!collision.isTrigger && !isSleepingPair(collision))
+        {
+            collision.a->getRigidbody()->colorMask_ = 0;
+            collision.b->getRigidbody()->colorMask_ = 0;
+        }
     }
 
-    if (pair.state == FColliderPair::STATE_ENTER)
+    // 按碰撞对的顺序贪心着色，保证结果是确定的
+    for (auto &pair : colliderPairs_)
     {
-        LOG_VERBOSE("CollisionEnter: %d-%d", a->getID(), b->getID());
-        pair.state = FColliderPair::STATE_STAY;
-        if (!a->getRigidbody()->isStatic())
+        FColliderPair &collision = pair.second;
+        if (collision.isTrigger || isSleepingPair(collision))
         {
-            a->getRigidbody()->setActive(true);
+            continue;
         }
-        if (!b->getRigidbody()->isStatic())
+
+        FRigidbody *a = collision.a->getRigidbody();
+        FRigidbody *b = collision.b->getRigidbody();
+
+        // 静态刚体不会被修改，不占用颜色
+        uint64_t used = (a->isStatic() ? 0 : a->colorMask_) | (b->isStatic() ? 0 : b->colorMask_);
+        int color = 0;
+        while (color < MAX_SOLVER_COLORS && (used & ((uint64_t)1 << color)) != 0)
         {
-            b->getRigidbody()->setActive(true);
+            ++color;
         }
 
-        /*if (a->gameObject_ != nullptr && (a->filter_.mask & b->filter_.layer) != 0)
+        if (color < MAX_SOLVER_COLORS)
         {
-            a->gameObject_->collisionEnter(genCollision(b.get()));
+            uint64_t bit = (uint64_t)1 << color;
+            a->colorMask_ |= bit;
+            b->colorMask_ |= bit;
         }
-        if (b->gameObject_ != nullptr && (b->filter_.mask & a->filter_.layer) != 0)
-        {
-            b->gameObject_->collisionEnter(genCollision(a.get()));
-        }*/
+
+        pairColors_.push_back((uint8_t)color);
+        ++colorOffsets_[color + 1];
     }
-    else if (pair.state == FColliderPair::STATE_EXIT)
+
+    for (int i = 1; i < MAX_SOLVER_COLORS + 2; ++i)
     {
-        LOG_VERBOSE("CollisionExit: %d-%d", a->getID(), b->getID());
-        /*if (a->gameObject_ != nullptr && (a->filter_.mask & b->filter_.layer) != 0)
+        colorOffsets_[i] += colorOffsets_[i - 1];
+    }
+
+    // 按颜色分组。同一颜色内保持碰撞对原来的顺序
+    size_t cursor[MAX_SOLVER_COLORS + 1];
+    std::copy(colorOffsets_.begin(), colorOffsets_.end() - 1, cursor);
+
+    solverPairs_.resize(pairColors_.size());
+    size_t index = 0;
+    for (auto &pair : colliderPairs_)
+    {
+        FColliderPair &collision = pair.second;
+        if (!collision.isTrigger && !isSleepingPair(collision))
         {
-            a->gameObject_->collisionExit(genCollision(b.get()));
+            solverPairs_[cursor[pairColors_[index++]]++] = &collision;
         }
-        if (b->gameObject_ != nullptr && (b->filter_.mask & a->filter_.layer) != 0)
-        {
-            b->gameObject_->collisionExit(genCollision(a.get()));
-        }*/
     }
+}
 
-    if (pair.state == FColliderPair::STATE_STAY)
+void FPhysics2D::solveColoredPairs(FFloat dt)
+{
+    LS_PROFILER_BEGIN(PK_PHYSICS_PRE_SEPERATION);
+    colorColliderPairs();
+
+    // 最后一组颜色不够用，碰撞对之间可能共享刚体，只能串行
+    for (int color = 0; color <= MAX_SOLVER_COLORS; ++color)
     {
-        LOG_VERBOSE("CollisionStay: %d-%d, distance: %d, normal: (%d, %d)",
-            a->getID(), b->getID(), toi(pair.collisionInfo.distance),
-            toi(pair.collisionInfo.normal.x),
-            toi(pair.collisionInfo.normal.y));
+        FColliderPair **pairs = solverPairs_.data() + colorOffsets_[color];
+        size_t count = colorOffsets_[color + 1] - colorOffsets_[color];
 
-        /*if (a->gameObject_ != nullptr && (a->filter_.mask & b->filter_.layer) != 0)
+        if (threadPool_ != nullptr && color < MAX_SOLVER_COLORS)
         {
-            a->gameObject_->collisionStay(genCollision(b.get()));
+            threadPool_->parallelFor(count, SOLVER_BATCH_SIZE, [this, dt, pairs](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    doPreSeperation(dt, *pairs[i]);
+                }
+            });
         }
-        if (b->gameObject_ != nullptr && (b->filter_.mask & a->filter_.layer) != 0)
-        {
-            b->gameObject_->collisionStay(genCollision(a.get()));
-        }*/
-
-        // 触发器需要保持active状态，避免进入idle状态后，发生离开触发器的现象
-        if (pair.isTrigger)
+        else
         {
-            a->rigidbody_->setCollisionStamp(tickStamp);
-            b->rigidbody_->setCollisionStamp(tickStamp);
+            for (size_t i = 0; i < count; ++i)
+            {
+                doPreSeperation(dt, *pairs[i]);
+            }
         }
     }
+    LS_PROFILER_END(PK_PHYSICS_PRE_SEPERATION);
+
+    LS_PROFILER_BEGIN(PK_PHYSICS_POST_SEPERATION);
+    contactSolver_->build(solverPairs_.data(), colorOffsets_.data(), MAX_SOLVER_COLORS);
+    lastIteration_ = contactSolver_->solve(minIteration_, maxIteration, solverTolerance_, threadPool_);
+    contactSolver_->writeBack();
+    LS_PROFILER_END(PK_PHYSICS_POST_SEPERATION);
 }
 
-void FPhysics2D::onColliderBBChange(FCollider * collider)
+void FPhysics2D::buildIslands()
 {
-    if (!enableHandle_)
+    islandBuilder_->clear();
+    for (auto &pair : activeBodies_)
     {
-        return;
+        islandBuilder_->addBody(pair.second.get());
     }
 
-    auto tree = collider->rigidbody_->isStatic() ? staticTree_ : dynamicTree_;
-    tree->updateCollider(collider);
-}
-
-uint32_t FPhysics2D::allocateID()
-{
-    ++idCounter;
-    if (idCounter == 0)
+    for (auto &pair : colliderPairs_)
     {
-        idCounter = 1;
-        LOG_ERROR("id was overflow!");
+        if (!pair.second.isTrigger)
+        {
+            islandBuilder_->link(pair.second.a->getRigidbody(), pair.second.b->getRigidbody());
+        }
     }
-    return idCounter;
-}
-
-void FPhysics2D::doPreSeperation(FFloat dt, FColliderPair & collision)
-{
-    FRigidbody &a = *(collision.a->getRigidbody());
-    FRigidbody &b = *(collision.b->getRigidbody());
-
-    FCollisionInfo &info = collision.collisionInfo;
 
-    FVector3 normal = info.normal;
-    FVector3 tangent(-normal.z, FFloat(0), normal.x);
-
-    FFloat kNormal = a.getPointMoment(info.pointA, normal) + b.getPointMoment(info.pointB, normal);
-    info.massNormal = FFloat(1) / kNormal;
-
-    FFloat kTangent = a.getPointMoment(info.pointA, tangent) + b.getPointMoment(info.pointB, tangent);
-    info.massTangent = FFloat(1) / kTangent;
-
-    info.bias = biasFactor_ * FMath::max(FFloat(0), info.distance - allowedPenetration_) / dt;
-
-    FVector3 F = normal * info.forceNormal + tangent * info.forceTangent;
-    a.applyImpulse(-F);
-    a.applyTorqueImpulse(info.pointA, -F);
-
-    b.applyImpulse(F);
-    b.applyTorqueImpulse(info.pointB, F);
+    // 岛屿中只要有一个活跃的刚体，整个岛屿都要唤醒
+    size_t count = islandBuilder_->getBodyCount();
+    islandFlags_.assign(count, 0);
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (islandBuilder_->getBody(i)->isActive())
+        {
+            islandFlags_[islandBuilder_->findRoot((int)i)] = 1;
+        }
+    }
 
-    LOG_VERBOSE("PreSeperation: %d-%d, penetrate: %d, bias: %d, impulse(%d, %d)",
-        collision.a->getID(), collision.b->getID(), toi(info.distance), toi(info.bias), toi(F.x), toi(F.y));
+    for (size_t i = 0; i < count; ++i)
+    {
+        FRigidbody *rigidbody = islandBuilder_->getBody(i);
+        if (!rigidbody->isActive() && islandFlags_[islandBuilder_->findRoot((int)i)])
+        {
+            rigidbody->setActive(true);
+        }
+    }
 }
 
-void FPhysics2D::doPostSeperation(FFloat dt, FColliderPair &collision)
+void FPhysics2D::sleepIslands()
 {
-    FRigidbody &a = *(collision.a->getRigidbody());
-    FRigidbody &b = *(collision.b->getRigidbody());
-
-    FCollisionInfo &contact = collision.collisionInfo;
-    FFloat fraction = FFloat(1) - (contact.a->getFriction() + contact.a->getFriction()) / 2;
-
-    // 计算分离力
-    FVector3 relativeVelocity = a.getPointVelocity(contact.pointA) - b.getPointVelocity(contact.pointB);
-
-    FVector3 normal = contact.normal;
-    FFloat vn = relativeVelocity.dot(normal);
-    FFloat dFn = (vn + contact.bias) * contact.massNormal;
-    FFloat oldFn = contact.forceNormal;
-    // 限制一个最大的力，避免越界
-    contact.forceNormal = FMath::clamp(oldFn + dFn, FFloat(0), FFloat(1000));
-    dFn = contact.forceNormal - oldFn;
-    
-    FVector3 F = normal * dFn;
-    a.applyImpulse(-F);
-    a.applyTorqueImpulse(contact.pointA, -F);
-
-    b.applyImpulse(F);
-    b.applyTorqueImpulse(contact.pointB, F);
-
-    LOG_VERBOSE("doPostSeperation-normal: %d-%d, impulse(%d, %d), accumulate: %d, rv(%d, %d) v1(%d, %d), v2(%d, %d)",
-        collision.a->getID(), collision.b->getID(), toi(F.x), toi(F.y),
-        toi(contact.forceNormal),
-        toi(relativeVelocity.x), toi(relativeVelocity.y),
-        toi(a.velocity.x), toi(a.velocity.y),
-        toi(b.velocity.x), toi(b.velocity.y));
-    
-    // 计算摩擦力
-    relativeVelocity = a.getPointVelocity(contact.pointA) - b.getPointVelocity(contact.pointB);
-
-    FVector3 tangent(-normal.z, FFloat(0), normal.x);
-    FFloat vt = relativeVelocity.dot(tangent);
-    FFloat dFt = vt * contact.massTangent;
-    FFloat maxFt = fraction * contact.forceNormal;
-    FFloat oldFt = contact.forceTangent;
-    contact.forceTangent = FMath::clamp(oldFt + dFt, -maxFt, maxFt);
-    dFt = contact.forceTangent - oldFt;
+    size_t count = islandBuilder_->getBodyCount();
+    islandFlags_.assign(count, 1);
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (!islandBuilder_->getBody(i)->canSleep())
+        {
+            islandFlags_[islandBuilder_->findRoot((int)i)] = 0;
+        }
+    }
 
-    F = tangent * dFt;
-    a.applyImpulse(-F);
-    a.applyTorqueImpulse(contact.pointA, -F);
+    for (auto it = activeBodies_.begin(); it != activeBodies_.end(); )
+    {
+        FRigidbodyPtr rigidbody = it->second;
+        int index = rigidbody->islandIndex_;
+        bool sleep = index >= 0 ?
+            islandFlags_[islandBuilder_->findRoot(index)] != 0 :
+            rigidbody->canSleep();
 
-    b.applyImpulse(F);
-    b.applyTorqueImpulse(contact.pointB, F);
+        if (sleep)
+        {
+            rigidbody->isActive_ = false;
+            it = activeBodies_.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
 
-    LOG_VERBOSE("doPostSeperation-tangent: %d-%d, impulse(%d, %d), accumulate: %d, v(%d, %d)",
-        collision.a->getID(), collision.b->getID(), toi(F.x), toi(F.y),
-        toi(contact.forceTangent),
-        toi(relativeVelocity.x), toi(relativeVelocity.y));
+    islandBuilder_->clear();
 }
 
 size_t FPhysics2D::getBVHNodeCount()
@@ -921,6 +3101,17 @@ size_t FPhysics2D::getMemorySize()
         dynamicTree_->getMemorySize() +
         staticTree_->getMemorySize() +
         gjk_->getMemorySize() +
+        queryContext_->getMemorySize() +
+        (querySnapshot_ ? querySnapshot_->getMemorySize() : 0) +
+        (spareSnapshot_ ? spareSnapshot_->getMemorySize() : 0) +
+        islandBuilder_->getMemorySize() +
+        contactSolver_->getMemorySize() +
+        projectileSystem_->getMemorySize() +
+        islandFlags_.capacity() +
+        solverPairs_.capacity() * sizeof(FColliderPair*) +
+        colorOffsets_.capacity() * sizeof(size_t) +
+        pairColors_.capacity() +
+        pendingRemovePairs_.capacity() * sizeof(uint64_t) +
         rigidbodys_.capacity() * sizeof(FRigidbodyPtr) +
         activeBodies_.size() * sizeof(std::map<uint32_t, FRigidbodyPtr>::value_type) +
         colliderPairs_.size() * sizeof(std::map<uint64_t, FColliderPair>::value_type) +
@@ -15,11 +15,19 @@
 
 #include <vector>
 #include <map>
+#include <memory>
 
 NS_FXP_BEGIN
 
 class FBVHTree;
 class FGJK;
+class FIslandBuilder;
+class FThreadPool;
+class FContactSolver;
+class FProjectileSystem;
+class FQueryContext;
+class FQuerySnapshot;
+class FWorldState;
 
 /** 基于定点数的2D物理引擎 */
 class FXP_API FPhysics2D : public IRefCount
@@ -36,6 +44,36 @@ public:
 
     void tick(FFloat deltaTime);
 
+    /** 固定步长推进。累积真实流逝的时间，按getFixedDeltaTime的步长执行0到N次tick。
+     *  一次最多执行getMaxStepsPerAdvance次，超出的整步会被丢弃，避免卡顿之后越追越慢；不足一步的时间会保留。
+     *  @return 本次执行的tick次数
+     */
+    int advance(FFloat elapsedTime);
+
+    /** 回滚之后快速追帧。连续执行count次tick，结果与逐次调用tick完全相同。
+     *  期间不输出逐碰撞对的日志，不统计内部的性能分析结点，只在最后发布一次查询快照。
+     *  不修改advance累积的时间。
+     */
+    void resimulate(FFloat deltaTime, int count);
+
+    /** 是否正在resimulate中。回调中可以据此跳过表现相关的逻辑 */
+    bool isResimulating() const { return resimulating_; }
+
+    /// 获取固定步长
+    FFloat getFixedDeltaTime() const { return fixedDeltaTime_; }
+    /// 设置固定步长，默认1/30秒
+    void setFixedDeltaTime(FFloat dt) { fixedDeltaTime_ = dt; }
+
+    /// 获取advance一次最多执行的tick次数
+    int getMaxStepsPerAdvance() const { return maxStepsPerAdvance_; }
+    /// 设置advance一次最多执行的tick次数，默认5
+    void setMaxStepsPerAdvance(int n) { maxStepsPerAdvance_ = n; }
+
+    /** 插值系数。累积的剩余时间占固定步长的比例，范围[0, 1)。
+     *  渲染时使用FRigidbody::getInterpolatedPosition(alpha)在上一次和当前的tick结果之间插值。
+     */
+    FFloat getInterpolationAlpha() const;
+
     void addRigidbody(FRigidbody *rigidbody);
 
     void removeRigidbody(FRigidbody *rigidbody);
@@ -49,16 +87,150 @@ public:
     
     /** 射线拾取。查询与射线相交且距离最近的碰撞体 */
     bool linecast(const FVector3 &start, const FVector3 &end, FFloat radius, const FColliderFilter &filter, FRaycastHit &hit);
-    //bool linecastAll(const FRay &ray, std::vector<FRaycastHit> &hits);
+
+    /** 查询与线段相交的所有碰撞体，只遍历一次BVH树。每个碰撞体只记录第一个碰撞点。
+     *  @param hits     结果追加到hits的末尾，追加的部分按距离从近到远排序。调用者可以复用hits，避免重复分配内存
+     *  @param maxHits  最多保留的数量，只保留最近的maxHits个。0表示不限制
+     *  @return 追加的数量
+     */
+    int linecastAll(const FVector3 &start, const FVector3 &end, const FColliderFilter &filter,
+        std::vector<FRaycastHit> &hits, size_t maxHits = 0);
+
+    /** 批量射线拾取。相邻的射线按FBVHTree::RAY_PACKET_SIZE条一组同时遍历BVH树，
+     *  起点和方向相近的射线放在一起，可以共享更多的结点检测。
+     *  @param rays     射线。调用者可以缓存FRay，避免每次计算长度
+     *  @param filters  每条射线的碰撞过滤参数
+     *  @param hits     与rays一一对应的结果，没有碰撞时collider为空
+     *  @return 发生碰撞的射线数量
+     */
+    int linecastBatch(const FRay *rays, const FColliderFilter *filters, size_t count, FRaycastHit *hits);
+
+    /** 视线检测。线段被任意碰撞体阻挡就返回true，找到第一个碰撞点后立即结束，不计算最近的碰撞点 */
+    bool occluded(const FVector3 &start, const FVector3 &end, const FColliderFilter &filter);
+
+    /** 批量视线检测，按射线包遍历BVH树。
+     *  @param results  与rays一一对应，被阻挡为true
+     *  @return 被阻挡的射线数量
+     */
+    int occludedBatch(const FRay *rays, const FColliderFilter *filters, size_t count, bool *results);
 
     /** 查询与collider相交的碰撞体 */
     FCollider* colliderCast(FCollider *collider);
 
+    /** 圆形扫掠。查询半径为radius的圆从start移动到end时，最先撞到的碰撞体。
+     *  hit.distance是撞击前移动的距离，hit.normal是撞击点的表面法线，指向圆。
+     *  起点就相交的碰撞体也会被报告，此时distance为0。
+     */
+    bool circleCast(const FVector3 &start, const FVector3 &end, FFloat radius, const FColliderFilter &filter, FRaycastHit &hit);
+
+    /** 碰撞体扫掠。查询collider从当前位置平移motion时，最先撞到的碰撞体，只考虑平移不考虑旋转。
+     *  collider可以不在物理世界中，使用collider自身的碰撞过滤参数。结果与circleCast相同
+     */
+    bool colliderCast(FCollider *collider, const FVector3 &motion, FRaycastHit &hit);
+
     /** 查询与collider相交的所有碰撞体 */
     bool colliderCastAll(FCollider *collider, std::vector<FCollider*> &targets);
 
+    /** 以下查询使用context中的遍历栈和GJK，不修改物理世界和BVH树的状态。
+     *  每个线程使用自己的context，可以在两次tick之间并发调用。并发查询期间不能tick，也不能修改刚体和碰撞体。
+     *  结果与对应的单线程查询相同。
+     */
+    FCollider* pointCast(const FVector3 &point, FFloat radius, FQueryContext &context) const;
+    bool linecast(const FVector3 &start, const FVector3 &end, FFloat radius, const FColliderFilter &filter, FRaycastHit &hit,
+        FQueryContext &context) const;
+    bool occluded(const FVector3 &start, const FVector3 &end, const FColliderFilter &filter, FQueryContext &context) const;
+    FCollider* colliderCast(FCollider *collider, FQueryContext &context) const;
+
+    /** 查询与圆相交的碰撞体，不包括触发器。结果写入调用者提供的results，写满capacity个就停止查询。
+     *  @param flags    查询范围。@see FQueryFlag
+     *  @return 写入results的数量
+     */
+    int overlapCircle(const FVector3 &center, FFloat radius, const FColliderFilter &filter,
+        FCollider **results, int capacity, int flags = FQ_ALL);
+
+    /** 查询与矩形相交的碰撞体。矩形的尺寸为width * height，绕中心旋转angle度。其它参数与overlapCircle相同 */
+    int overlapBox(const FVector3 &center, FFloat width, FFloat height, FFloat angle, const FColliderFilter &filter,
+        FCollider **results, int capacity, int flags = FQ_ALL);
+
+    /** 查询与凸多边形相交的碰撞体。vertices是世界坐标。其它参数与overlapCircle相同 */
+    int overlapPolygon(const FVector3 *vertices, size_t count, const FColliderFilter &filter,
+        FCollider **results, int capacity, int flags = FQ_ALL);
+
+    /** 扇形查询，用于AI视野。查询包围盒中心在扇形内的碰撞体，不包括触发器。
+     *  BVH遍历时直接按扇形裁剪结点，不需要先查询圆形再逐个过滤角度。
+     *  @param forward          扇形的朝向，不需要是单位向量
+     *  @param angle            扇形的张角，单位: 度。例如90表示朝向两侧各45度
+     *  @param occluderFilter   不为空时，剔除从origin到目标中心的视线被静态碰撞体阻挡的目标
+     *  @return 写入results的数量
+     */
+    int overlapSector(const FVector3 &origin, const FVector3 &forward, FFloat radius, FFloat angle, const FColliderFilter &filter,
+        FCollider **results, int capacity, int flags = FQ_ALL, const FColliderFilter *occluderFilter = nullptr);
+
+    /** 统计包围盒与[min, max]区域相交、且layer & layerMask不为0的碰撞体数量，包括触发器。
+     *  不需要逐个访问碰撞体，完全在区域内的BVH子树直接使用子树的统计数据。
+     *  @param flags    查询范围。@see FQueryFlag
+     */
+    int countColliders(const FVector3 &min, const FVector3 &max, uint32_t layerMask, int flags = FQ_ALL);
+
+    /** 最近邻查询。查询离point最近的k个碰撞体，不包括触发器。
+     *  距离是point到碰撞体表面的距离，point在碰撞体内部时为0。只访问可能包含这k个碰撞体的BVH结点。
+     *  @param maxDistance  搜索半径
+     *  @param results      按距离从近到远写入，容量至少为k
+     *  @param distances    与results对应的距离，可以为空
+     *  @return 写入results的数量
+     */
+    int queryNearest(const FVector3 &point, int k, FFloat maxDistance, const FColliderFilter &filter,
+        FCollider **results, FFloat *distances = nullptr, int flags = FQ_ALL);
+
+    /** 查询离point最近的碰撞体，搜索半径内没有则返回空 */
+    FCollider* findNearest(const FVector3 &point, FFloat maxDistance, const FColliderFilter &filter, int flags = FQ_ALL);
+
+    /** 两个碰撞体表面之间的最近距离，相交时返回0。碰撞体可以不在物理世界中 */
+    FFloat distance(FCollider *colliderA, FCollider *colliderB);
+
+    /** 查询离collider表面最近的碰撞体，不包括触发器和同一刚体上的碰撞体。
+     *  hit.distance是两个表面之间的距离，hit.point是目标上的最近点，hit.normal从hit.point指向collider。
+     *  @param filter       用来过滤目标，不使用collider自身的过滤参数
+     *  @param maxDistance  搜索半径
+     *  @return maxDistance范围内没有碰撞体时返回false
+     */
+    bool distanceToNearest(FCollider *collider, const FColliderFilter &filter, FFloat maxDistance, FRaycastHit &hit, int flags = FQ_ALL);
+
+    /** 批量查询。结果写入hits[i]，没有找到的hits[i].collider为空
+     *  @return 找到最近碰撞体的数量
+     */
+    int distanceToNearestBatch(FCollider *const *colliders, size_t count, const FColliderFilter &filter, FFloat maxDistance,
+        FRaycastHit *hits, int flags = FQ_ALL);
+
     FRigidbody* getStaticRigidbody(){ return staticRigidbody_.get(); }
 
+    /** 子弹系统。每次tick的最后更新 */
+    FProjectileSystem* getProjectileSystem() { return projectileSystem_; }
+
+    /** 图着色求解使用的接触约束求解器。@see setSolverThreadCount */
+    FContactSolver* getContactSolver() { return contactSolver_; }
+
+    /** 开启后，每次tick结束时发布一份不可修改的查询快照，其它线程可以在下一次tick进行的同时查询。
+     *  快照使用双缓冲，没有被读者持有的旧快照会在下次发布时复用。@see FQuerySnapshot
+     *  静态部分会被缓存，只在静态碰撞体发生变化时重新复制。直接调用setGroup、setMask、setTrigger
+     *  修改静态碰撞体不会被检测到，需要在修改后调用onStaticShapeChange。
+     */
+    void setQuerySnapshotEnable(bool enable);
+    bool isQuerySnapshotEnabled() const { return snapshotEnabled_; }
+
+    /** 获取最近一次发布的快照，可以在任意线程调用。持有返回值期间快照不会被回收。没有开启时返回空 */
+    std::shared_ptr<const FQuerySnapshot> getQuerySnapshot() const;
+
+    /** 保存整个物理世界的模拟状态，用于帧同步回滚。在两次tick之间调用。
+     *  state可以反复使用，数组的内存会被复用。@see FWorldState
+     */
+    void saveState(FWorldState &state);
+    /** 恢复到saveState保存的状态。耗时与状态的大小成正比，不会重新添加刚体和碰撞体。
+     *  保存之后增删了刚体或碰撞体时返回false，物理世界保持不变。
+     *  @param publishSnapshot 是否发布查询快照。紧接着调用resimulate追帧时可以传false，由resimulate在最后发布
+     */
+    bool restoreState(const FWorldState &state, bool publishSnapshot = true);
+
     /** 获取结点总数量，包括叶结点 */
     size_t getBVHNodeCount();
     /** 获取叶结点数量。也就是collider的数量 */
@@ -91,6 +263,36 @@ public:
     /// 设置计算迭代次数
     void setSolverIterations(int v) { maxIteration = v; }
 
+    /// 获取最少迭代次数
+    int getSolverMinIterations() const { return minIteration_; }
+    /// 设置最少迭代次数。达到最少次数后，冲量变化收敛了就提前结束迭代
+    void setSolverMinIterations(int v) { minIteration_ = v; }
+
+    /// 获取收敛阈值
+    FFloat getSolverTolerance() const { return solverTolerance_; }
+    /** 设置收敛阈值。一轮迭代中所有接触点的冲量变化都不超过此值，就认为已经收敛。
+     *  默认是0，只有冲量完全不再变化时才提前结束，结果与迭代满maxIteration次一致。
+     */
+    void setSolverTolerance(FFloat v) { solverTolerance_ = v; }
+
+    /// 上一帧实际的迭代次数
+    int getLastSolverIterations() const { return lastIteration_; }
+
+    /// 获取子步数量
+    int getSolverSubsteps() const { return solverSubsteps_; }
+    /** 设置子步数量。大于1时开启子步模式：每帧只做一次碰撞检测，然后把deltaTime分成n个子步，
+     *  每个子步依次计算速度、迭代一次接触约束、累积位移，最后再消除一次穿透修正带来的速度。
+     *  子步模式忽略setSolverIterations和setSolverThreadCount的设置，适合堆叠等收敛困难的场景。
+     */
+    void setSolverSubsteps(int n) { solverSubsteps_ = n; }
+
+    /** 设置求解器的线程数量，包括调用线程。
+     *  0表示按碰撞对的顺序串行求解；大于0则使用图着色求解，同一颜色内的碰撞对没有共享的动态刚体，
+     *  可以并行计算，迭代阶段使用FContactSolver。着色求解的结果与线程数量无关，但与串行求解的结果不同。
+     */
+    void setSolverThreadCount(int count);
+    int getSolverThreadCount() const { return solverThreadCount_; }
+
     /// 获取穿透容差
     FFloat getCollisionSlop() const {return allowedPenetration_; }
     /// 设置穿透容差
@@ -144,8 +346,17 @@ public: // 内部方法，不会导出给lua。
     /** @private 碰撞体包围盒发生了变化 */
     void onColliderBBChange(FCollider *collider);
 
+    /** @private 碰撞体的layer发生了变化 */
+    void onColliderLayerChange(FCollider *collider);
+
+    /** 静态碰撞体的变换或过滤参数发生了变化，查询快照需要重新复制静态部分 */
+    void onStaticShapeChange() { ++staticShapeStamp_; }
+
     /** @private 是否已经存在碰撞对了 */
     bool existColliderPair(FCollider *a, FCollider *b);
+
+    /** @private 查找碰撞对，不存在则返回NULL */
+    FColliderPair* findColliderPair(FCollider *a, FCollider *b);
     
     /** @private 添加碰撞对 */
     void addColliderPair(const FCollisionInfo &info);
@@ -153,6 +364,12 @@ public: // 内部方法，不会导出给lua。
     /** @private */
     FGJK* getGJK() { return gjk_; }
 
+    /** @private */
+    FBVHTree* getDynamicTree() { return dynamicTree_; }
+
+    /** @private */
+    FBVHTree* getStaticTree() { return staticTree_; }
+
     /** @private */
     const std::map<uint64_t, FColliderPair>& getColliderPairs() const { return colliderPairs_; }
     
@@ -168,7 +385,35 @@ private:
     void updateColliderPair(FFloat dt, FColliderPair &pair);
     
     void doPreSeperation(FFloat dt, FColliderPair &collision);
-    void doPostSeperation(FFloat dt, FColliderPair &collision);
+    /** 返回本次计算中冲量变化的最大绝对值 */
+    FFloat doPostSeperation(FFloat dt, FColliderPair &collision);
+
+    /** 子步开始前，用刚体的累积位移估算穿透深度，更新偏置并应用上个子步的冲量 */
+    void doSubstepPreSeperation(FFloat dt, FColliderPair &collision);
+    /** 子步模式求解 */
+    void solveSubsteps(FFloat dt);
+
+    /** 区域查询的实现。shape是castRigidbody_上的碰撞体 */
+    int overlapShape(FCollider *shape, const FColliderFilter &filter, FCollider **results, int capacity, int flags);
+
+    /** 扫掠查询的实现 */
+    bool sweepCollider(FCollider *collider, const FVector2 &motion, FRaycastHit &hit);
+
+    /** 连续碰撞检测。限制开启了连续碰撞的刚体本帧的位移，避免穿过静态碰撞体 */
+    void solveContinuousCollision(FFloat dt);
+
+    /** 给参与求解的碰撞对着色，并按颜色分组 */
+    void colorColliderPairs();
+    /** 按颜色分组求解。同一颜色内并行，颜色之间串行 */
+    void solveColoredPairs(FFloat dt);
+
+    /** 构建岛屿，并唤醒包含活跃刚体的岛屿 */
+    void buildIslands();
+    /** 所有刚体都满足休眠条件的岛屿，整体进入休眠 */
+    void sleepIslands();
+
+    /** 生成查询快照，替换掉当前发布的快照 */
+    void publishQuerySnapshot();
     
 private:
     std::vector<FRigidbodyPtr> rigidbodys_;
@@ -178,9 +423,48 @@ private:
     FBVHTree*       dynamicTree_;
     FBVHTree*       staticTree_;
     FGJK*           gjk_;
+    /** 单线程查询使用的context */
+    FQueryContext*  queryContext_;
+    /** 当前发布的查询快照。FRigidbody等使用的引用计数不是线程安全的，快照使用shared_ptr */
+    std::shared_ptr<const FQuerySnapshot> querySnapshot_;
+    /** 上一次发布的快照。下次发布时，如果没有读者持有就复用 */
+    std::shared_ptr<FQuerySnapshot> spareSnapshot_;
+    FIslandBuilder* islandBuilder_;
+    /** 岛屿的标记缓存，以岛屿的根索引访问 */
+    std::vector<uint8_t> islandFlags_;
+    FThreadPool*    threadPool_ = nullptr;
+    FContactSolver* contactSolver_;
+    FProjectileSystem* projectileSystem_;
+    int             solverThreadCount_ = 0;
+    /** 按颜色分组后的碰撞对。最后一组是颜色不够用的碰撞对，需要串行求解 */
+    std::vector<FColliderPair*> solverPairs_;
+    /** 每种颜色在solverPairs_中的起始位置 */
+    std::vector<size_t> colorOffsets_;
+    /** 着色的临时缓存 */
+    std::vector<uint8_t> pairColors_;
     FRigidbodyPtr   staticRigidbody_;
+    /** circleCast和区域查询使用的刚体和碰撞体，不在物理世界中 */
+    FRigidbodyPtr   castRigidbody_;
+    FColliderPtr    castCircle_;
+    FColliderPtr    castPolygon_;
+    /** 最近邻查询的距离缓存 */
+    std::vector<FFloat> nearestDistances_;
+    /** 扇形查询的候选结果。视线检测需要在BVH遍历结束后进行 */
+    std::vector<FCollider*> sectorCandidates_;
+    /** tick中待删除的碰撞对，复用内存 */
+    std::vector<uint64_t> pendingRemovePairs_;
     int             tickStamp = 0;
     int             maxIteration = 5;
+    int             minIteration_ = 1;
+    int             lastIteration_ = 0;
+    int             solverSubsteps_ = 1;
+    int             maxStepsPerAdvance_ = 5;
+    /** advance的固定步长 */
+    FFloat          fixedDeltaTime_ = FFloat(1) / 30;
+    /** advance累积的、还不够一个步长的时间 */
+    FFloat          accumulatedTime_;
+    /** 冲量变化的收敛阈值 */
+    FFloat          solverTolerance_;
 
     /** 重新构建aabb树的阈值 */
     int             rebuildTreeThreshold_ = 100;
@@ -199,6 +483,8 @@ private:
     FFloat          allowedPenetration_ = FFloat(0, 0, 1);
 
     uint32_t        idCounter = 0;
+    /** 静态碰撞体的变化计数 */
+    uint32_t        staticShapeStamp_ = 0;
     
     /// 世界的y坐标。由于是2d物理引擎，y只能取一个平面
     FFloat         worldY_ = FFloat(0);
@@ -206,6 +492,8 @@ private:
     /// 是否使用统一的世界y坐标。
     bool            worldYEnabled_ = false;
     bool            enableHandle_ = true;
+    bool            snapshotEnabled_ = false;
+    bool            resimulating_ = false;
 
     /// 静态shape的碰撞参数
     FColliderFilter   staticShapeFilter_;
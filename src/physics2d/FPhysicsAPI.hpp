@@ -9,3 +9,8 @@
 #include "FPhysics2D.hpp"
 #include "FRigidbody.hpp"
 #include "FCollider.hpp"
+#include "FProjectileSystem.hpp"
+#include "FInterestQuery.hpp"
+#include "FQueryContext.hpp"
+#include "FQuerySnapshot.hpp"
+#include "FWorldState.hpp"
@@ -41,6 +41,16 @@ enum FColliderType
     FT_POLYGON,
 };
 
+/// 区域查询的范围，可以组合使用
+enum FQueryFlag
+{
+    /// 查询静态碰撞体
+    FQ_STATIC = 1,
+    /// 查询动态和动力学碰撞体
+    FQ_DYNAMIC = 2,
+    FQ_ALL = FQ_STATIC | FQ_DYNAMIC,
+};
+
 /// 碰撞回调参数
 struct Collision
 {
@@ -71,19 +81,20 @@ public:
         this->layer = layer;
         this->mask = mask;
     }
+
+    bool operator == (const FColliderFilter &other) const { return group == other.group && layer == other.layer && mask == other.mask; }
+    bool operator != (const FColliderFilter &other) const { return !(*this == other); }
 };
 
 
-class FCollisionInfo
+/// 接触点
+class FContactPoint
 {
 public:
-    FCollider*      a = nullptr;
-    FCollider*      b = nullptr;
-    FVector3        normal;
-    FFloat          distance = FFloat(0);
-
     FVector3        pointA;
     FVector3        pointB;
+    /// 穿透深度
+    FFloat          distance = FFloat(0);
 
     /// 法线方向的分离力
     FFloat          forceNormal = FFloat(0);
@@ -96,7 +107,28 @@ public:
     /// 切线方向的质量系数
     FFloat          massTangent = FFloat(0);
 
-    int             hash = 0;
+    /// 特征id。由参考边和入射顶点组成，用于帧间匹配接触点，继承累积的分离力。0表示没有特征信息
+    uint32_t        id = 0;
+};
+
+class FCollisionInfo
+{
+public:
+    /// 最大接触点数量。多边形之间最多有两个接触点
+    static const int MAX_POINTS = 2;
+
+    FCollider*      a = nullptr;
+    FCollider*      b = nullptr;
+    FVector3        normal;
+    /// 最大穿透深度
+    FFloat          distance = FFloat(0);
+
+    FContactPoint   points[MAX_POINTS];
+    int             pointCount = 0;
+
+    /// GJK在a、b上最后使用的support顶点索引。作为下一帧爬山查找的起点
+    int             supportA = -1;
+    int             supportB = -1;
 };
 
 class FRaycastHit
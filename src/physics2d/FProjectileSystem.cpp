@@ -0,0 +1,181 @@
+﻿//////////////////////////////////////////////////////////////////////
+/// Desc  FProjectileSystem
+/// Time  2026/10/18
+/// Author youlanhai
+//////////////////////////////////////////////////////////////////////
+
+#include "FProjectileSystem.hpp"
+#include "FPhysics2D.hpp"
+#include "FBVHTree.hpp"
+#include "FCollider.hpp"
+#include "debug/Profiler.hpp"
+
+NS_FXP_BEGIN
+
+/** 查询线段最先撞到的碰撞体 */
+class QueryProjectileHit
+{
+public:
+    FRay ray;
+    const FColliderFilter *filter = nullptr;
+    FRaycastHit hit;
+    FRaycastHit tempHit;
+    bool collide = false;
+
+    FFloat operator()(FBVHNode *node)
+    {
+        FCollider *collider = node->collider.get();
+        if (!collider->isTrigger() && filter->canCollide(collider->getFilter()) && collider->rayCast(ray, tempHit))
+        {
+            if (!collide || tempHit.distance < hit.distance)
+            {
+                hit = tempHit;
+            }
+            collide = true;
+            return tempHit.distance;
+        }
+        return ray.distance + FFloat(1);
+    }
+};
+
+FProjectileSystem::FProjectileSystem(FPhysics2D *physics)
+    : physics_(physics)
+{
+}
+
+FProjectileSystem::~FProjectileSystem()
+{
+}
+
+uint32_t FProjectileSystem::add(const FVector3 &position, const FVector3 &velocity, FFloat lifeTime, const FColliderFilter &filter)
+{
+    FProjectile projectile;
+    projectile.id = ++idCounter_;
+    projectile.position = position.toXZ();
+    projectile.velocity = velocity.toXZ();
+    projectile.lifeTime = lifeTime;
+    projectile.filter = filter;
+    indices_[projectile.id] = projectiles_.size();
+    projectiles_.push_back(projectile);
+    return projectile.id;
+}
+
+bool FProjectileSystem::remove(uint32_t id)
+{
+    auto it = indices_.find(id);
+    if (it == indices_.end())
+    {
+        return false;
+    }
+
+    removeAt(it->second);
+    return true;
+}
+
+void FProjectileSystem::removeAt(size_t i)
+{
+    indices_.erase(projectiles_[i].id);
+
+    size_t last = projectiles_.size() - 1;
+    if (i != last)
+    {
+        projectiles_[i] = projectiles_[last];
+        indices_[projectiles_[i].id] = i;
+    }
+    projectiles_.pop_back();
+}
+
+void FProjectileSystem::rebuildIndices()
+{
+    indices_.clear();
+    for (size_t i = 0; i < projectiles_.size(); ++i)
+    {
+        indices_[projectiles_[i].id] = i;
+    }
+}
+
+void FProjectileSystem::clear()
+{
+    projectiles_.clear();
+    indices_.clear();
+    hits_.clear();
+}
+
+void FProjectileSystem::update(FFloat deltaTime)
+{
+    hits_.clear();
+    if (projectiles_.empty())
+    {
+        return;
+    }
+
+    LS_PROFILER(PK_PHYSICS_PROJECTILE);
+
+    FBVHTree *dynamicTree = physics_->getDynamicTree();
+    FBVHTree *staticTree = physics_->getStaticTree();
+
+    QueryProjectileHit query;
+    for (size_t i = 0; i < projectiles_.size(); )
+    {
+        FProjectile &projectile = projectiles_[i];
+
+        FFloat dt = FMath::min(deltaTime, projectile.lifeTime);
+        projectile.lifeTime -= deltaTime;
+
+        FVector2 end = projectile.position + projectile.velocity * dt;
+        query.ray.set(projectile.position, end);
+        query.filter = &projectile.filter;
+        query.collide = false;
+
+        if (query.ray.distance > 0)
+        {
+            query.hit.distance = query.ray.distance;
+            dynamicTree->queryByRay(query.ray.start, query.ray.normal, query.hit.distance, query);
+            staticTree->queryByRay(query.ray.start, query.ray.normal, query.hit.distance, query);
+        }
+
+        if (query.collide)
+        {
+            FProjectileHit hit;
+            hit.id = projectile.id;
+            hit.collider = query.hit.collider;
+            hit.point = query.hit.point;
+            hit.normal = query.hit.normal;
+            hits_.push_back(hit);
+        }
+        else if (projectile.lifeTime > 0)
+        {
+            projectile.position = end;
+            ++i;
+            continue;
+        }
+
+        // 撞击或者到期的子弹，用最后一个子弹填补空位
+        removeAt(i);
+    }
+}
+
+void FProjectileSystem::saveState(FProjectileState &state) const
+{
+    state.projectiles = projectiles_;
+    state.hits = hits_;
+    state.idCounter = idCounter_;
+}
+
+void FProjectileSystem::restoreState(const FProjectileState &state)
+{
+    projectiles_ = state.projectiles;
+    hits_ = state.hits;
+    idCounter_ = state.idCounter;
+    rebuildIndices();
+}
+
+size_t FProjectileSystem::getMemorySize() const
+{
+    return sizeof(*this) +
+        projectiles_.capacity() * sizeof(FProjectile) +
+        indices_.size() * sizeof(std::unordered_map<uint32_t, size_t>::value_type) +
+        hits_.capacity() * sizeof(FProjectileHit);
+}
+
+NS_FXP_END
@@ -0,0 +1,103 @@
+﻿//////////////////////////////////////////////////////////////////////
+/// Desc  FProjectileSystem
+/// Time  2026/10/18
+/// Author youlanhai
+//////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "math/FVector2.hpp"
+#include "math/FVector3.hpp"
+#include "FPhysicsDef.hpp"
+
+#include <vector>
+#include <unordered_map>
+
+NS_FXP_BEGIN
+
+class FPhysics2D;
+
+/** 子弹。只需要知道第一个撞到的碰撞体，不参与碰撞求解 */
+class FProjectile
+{
+public:
+    uint32_t        id = 0;
+    FVector2        position;
+    FVector2        velocity;
+    /** 剩余的存活时间 */
+    FFloat          lifeTime;
+    FColliderFilter filter;
+};
+
+/** 子弹的撞击结果 */
+class FProjectileHit
+{
+public:
+    /** 子弹的id */
+    uint32_t        id = 0;
+    FCollider*      collider = nullptr;
+    FVector3        point;
+    FVector3        normal;
+};
+
+/** 子弹系统的状态，用于回滚 */
+class FProjectileState
+{
+public:
+    std::vector<FProjectile>    projectiles;
+    std::vector<FProjectileHit> hits;
+    uint32_t                    idCounter = 0;
+};
+
+/** 子弹系统。子弹保存在连续的数组中，每帧把位移当作线段，在BVH树中查询第一个撞到的碰撞体。
+ *  相比用刚体模拟子弹，不需要BVH叶结点、碰撞对和约束求解。
+ *  由FPhysics2D在每次tick的最后更新，此时刚体已经移动到了本帧的位置。
+ */
+class FXP_API FProjectileSystem
+{
+    DISABLE_COPY_AND_ASSIGN(FProjectileSystem);
+public:
+    explicit FProjectileSystem(FPhysics2D *physics);
+    ~FProjectileSystem();
+
+    /** 发射子弹。不会与触发器碰撞，filter用于过滤碰撞体的layer，与发射者同group可以避免打到自己。
+     *  @param lifeTime 存活时间，到期后自动移除
+     *  @return 子弹的id
+     */
+    uint32_t add(const FVector3 &position, const FVector3 &velocity, FFloat lifeTime, const FColliderFilter &filter);
+
+    /** 移除子弹。返回false表示子弹不存在 */
+    bool remove(uint32_t id);
+
+    /** 移除所有的子弹 */
+    void clear();
+
+    /** 移动子弹并检测撞击。撞到碰撞体或超过存活时间的子弹会被移除 */
+    void update(FFloat deltaTime);
+
+    size_t getCount() const { return projectiles_.size(); }
+    const FProjectile& getProjectile(size_t i) const { return projectiles_[i]; }
+
+    /** 最近一次update产生的撞击 */
+    const std::vector<FProjectileHit>& getHits() const { return hits_; }
+
+    /** 保存所有的子弹和最近一次的撞击 */
+    void saveState(FProjectileState &state) const;
+    void restoreState(const FProjectileState &state);
+
+    size_t getMemorySize() const;
+
+private:
+    /** 用最后一个子弹填补第i个子弹的空位 */
+    void removeAt(size_t i);
+    void rebuildIndices();
+
+    FPhysics2D*                 physics_;
+    std::vector<FProjectile>    projectiles_;
+    /** 子弹id到projectiles_下标的映射 */
+    std::unordered_map<uint32_t, size_t> indices_;
+    std::vector<FProjectileHit> hits_;
+    uint32_t                    idCounter_ = 0;
+};
+
+NS_FXP_END
@@ -0,0 +1,30 @@
+﻿//////////////////////////////////////////////////////////////////////
+/// Desc  FQueryContext
+/// Time  2026/10/18
+/// Author youlanhai
+//////////////////////////////////////////////////////////////////////
+
+#include "FQueryContext.hpp"
+#include "FGJK.hpp"
+
+NS_FXP_BEGIN
+
+FQueryContext::FQueryContext()
+{
+    gjk_ = new FGJK();
+}
+
+FQueryContext::~FQueryContext()
+{
+    delete gjk_;
+}
+
+size_t FQueryContext::getMemorySize() const
+{
+    return sizeof(*this) +
+        gjk_->getMemorySize() +
+        stack_.capacity() * sizeof(FBVHQueryNode) +
+        indexStack_.capacity() * sizeof(int);
+}
+
+NS_FXP_END
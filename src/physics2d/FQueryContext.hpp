@@ -0,0 +1,44 @@
+﻿//////////////////////////////////////////////////////////////////////
+/// Desc  FQueryContext
+/// Time  2026/10/18
+/// Author youlanhai
+//////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "FBVHTree.hpp"
+
+#include <vector>
+
+NS_FXP_BEGIN
+
+class FGJK;
+
+/** 查询使用的临时状态。
+ *  FPhysics2D的普通查询共用BVH树的遍历栈和物理世界的GJK，只能在一个线程中调用。
+ *  每个线程使用自己的FQueryContext调用带context参数的查询，可以在两次tick之间并发查询。
+ */
+class FXP_API FQueryContext
+{
+    DISABLE_COPY_AND_ASSIGN(FQueryContext);
+public:
+    FQueryContext();
+    ~FQueryContext();
+
+    FGJK* getGJK() { return gjk_; }
+
+    /** BVH树的遍历栈 */
+    std::vector<FBVHQueryNode>& getStack() { return stack_; }
+
+    /** 查询快照的遍历栈，保存结点索引 */
+    std::vector<int>& getIndexStack() { return indexStack_; }
+
+    size_t getMemorySize() const;
+
+private:
+    FGJK*                       gjk_;
+    std::vector<FBVHQueryNode>  stack_;
+    std::vector<int>            indexStack_;
+};
+
+NS_FXP_END
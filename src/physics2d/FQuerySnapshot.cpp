@@ -0,0 +1,362 @@
+﻿//////////////////////////////////////////////////////////////////////
+/// Desc  FQuerySnapshot
+/// Time  2026/10/18
+/// Author youlanhai
+//////////////////////////////////////////////////////////////////////
+
+#include "FQuerySnapshot.hpp"
+#include "FBVHTree.hpp"
+#include "FCollider.hpp"
+#include "FRigidbody.hpp"
+#include "FQueryContext.hpp"
+#include "FGJK.hpp"
+#include "FRay.hpp"
+
+NS_FXP_BEGIN
+
+FQuerySnapshot::FQuerySnapshot()
+{
+}
+
+FQuerySnapshot::~FQuerySnapshot()
+{
+}
+
+void FQuerySnapshot::build(FBVHTree *dynamicTree, FBVHTree *staticTree, uint32_t staticStamp, int tickStamp)
+{
+    if (staticCached_ && staticVersion_ == staticTree->getVersion() && staticStamp_ == staticStamp)
+    {
+        // 静态部分没有变化，只截掉上次的动态部分
+        nodes_.resize(staticNodeCount_);
+        shapes_.resize(staticShapeCount_);
+        vertices_.resize(staticVertexCount_);
+    }
+    else
+    {
+        nodes_.clear();
+        shapes_.clear();
+        vertices_.clear();
+
+        staticRoot_ = buildTree(staticTree->getRoot());
+        staticNodeCount_ = nodes_.size();
+        staticShapeCount_ = shapes_.size();
+        staticVertexCount_ = vertices_.size();
+        staticVersion_ = staticTree->getVersion();
+        staticStamp_ = staticStamp;
+        staticCached_ = true;
+    }
+
+    dynamicRoot_ = buildTree(dynamicTree->getRoot());
+    tickStamp_ = tickStamp;
+}
+
+int FQuerySnapshot::buildTree(FBVHNode *root)
+{
+    if (nullptr == root)
+    {
+        return -1;
+    }
+
+    // 先序遍历，父结点的索引总是小于子结点。pending保存<源结点, 父结点索引>
+    std::vector<std::pair<FBVHNode*, int>> &pending = pending_;
+    pending.clear();
+    pending.push_back(std::make_pair(root, -1));
+
+    int rootIndex = (int)nodes_.size();
+    while (!pending.empty())
+    {
+        FBVHNode *node = pending.back().first;
+        int parent = pending.back().second;
+        pending.pop_back();
+
+        int index = (int)nodes_.size();
+        nodes_.push_back(FSnapshotNode());
+        if (parent >= 0)
+        {
+            FSnapshotNode &p = nodes_[parent];
+            (p.left < 0 ? p.left : p.right) = index;
+        }
+
+        // 与BVH树一样使用向外扩展过的包围盒。射线与包围盒求交的精度有限，太薄的包围盒可能会漏掉碰撞体
+        nodes_[index].bb = node->bb;
+        if (node->isLeafNode())
+        {
+            nodes_[index].shape = (int)shapes_.size();
+            addShape(node->collider.get());
+        }
+        else
+        {
+            pending.push_back(std::make_pair(node->right, index));
+            pending.push_back(std::make_pair(node->left, index));
+        }
+    }
+    return rootIndex;
+}
+
+void FQuerySnapshot::addShape(FCollider *collider)
+{
+    FSnapshotShape shape;
+    shape.colliderID = collider->getID();
+    shape.bodyID = collider->getRigidbody()->getID();
+    shape.type = collider->getType();
+    shape.isTrigger = collider->isTrigger();
+    shape.filter = collider->getFilter();
+    shape.bounds = collider->getBounds();
+    shape.vertexBegin = (uint32_t)vertices_.size();
+
+    switch (shape.type)
+    {
+    case FT_CIRCLE:
+    {
+        FCircleCollider *circle = static_cast<FCircleCollider*>(collider);
+        shape.center = circle->getWorldCenter();
+        shape.radius = circle->getWorldRadius();
+        break;
+    }
+    case FT_SEGMENT:
+    {
+        FSegmentCollider *segment = static_cast<FSegmentCollider*>(collider);
+        vertices_.push_back(segment->getWorldStart());
+        vertices_.push_back(segment->getWorldEnd());
+        break;
+    }
+    case FT_POLYGON:
+    {
+        FPolygonCollider *polygon = static_cast<FPolygonCollider*>(collider);
+        vertices_.insert(vertices_.end(), polygon->getWorldVertices(), polygon->getWorldVertices() + polygon->getCount());
+        break;
+    }
+    default:
+        break;
+    }
+
+    shape.vertexCount = (uint32_t)vertices_.size() - shape.vertexBegin;
+    shapes_.push_back(shape);
+}
+
+bool FQuerySnapshot::rayCast(const FSnapshotShape &shape, const FRay &ray, FRaycastHit &hit) const
+{
+    switch (shape.type)
+    {
+    case FT_CIRCLE:
+        return rayCastCircle(shape.center, shape.radius, ray, hit);
+    case FT_SEGMENT:
+        return rayCastSegment(vertices_[shape.vertexBegin], vertices_[shape.vertexBegin + 1], ray, hit);
+    case FT_POLYGON:
+        return rayCastPolygon(getVertices(shape), shape.vertexCount, ray, hit);
+    default:
+        return false;
+    }
+}
+
+const FSnapshotShape* FQuerySnapshot::pointCast(const FVector3 &point3, FFloat radius, FQueryContext &context) const
+{
+    FVector2 point = point3.toXZ();
+    FBB bounds(point, radius);
+
+    std::vector<int> &stack = context.getIndexStack();
+    int roots[] = { dynamicRoot_, staticRoot_ };
+    for (int root : roots)
+    {
+        if (root < 0)
+        {
+            continue;
+        }
+
+        stack.clear();
+        stack.push_back(root);
+        while (!stack.empty())
+        {
+            const FSnapshotNode &node = nodes_[stack.back()];
+            stack.pop_back();
+
+            if (!node.bb.intersect(bounds))
+            {
+                continue;
+            }
+
+            if (node.shape < 0)
+            {
+                stack.push_back(node.left);
+                stack.push_back(node.right);
+                continue;
+            }
+
+            const FSnapshotShape &shape = shapes_[node.shape];
+            if (!shape.bounds.intersect(bounds))
+            {
+                continue;
+            }
+
+            bool overlap = false;
+            switch (shape.type)
+            {
+            case FT_CIRCLE:
+                overlap = overlapPointCircle(shape.center, shape.radius, point, radius);
+                break;
+            case FT_SEGMENT:
+                overlap = overlapPointSegment(vertices_[shape.vertexBegin], vertices_[shape.vertexBegin + 1], point, radius);
+                break;
+            case FT_POLYGON:
+                overlap = containsPoint(getVertices(shape), shape.vertexCount, point);
+                break;
+            default:
+                break;
+            }
+
+            if (overlap)
+            {
+                return &shape;
+            }
+        }
+    }
+    return nullptr;
+}
+
+bool FQuerySnapshot::queryByRay(int root, const FRay &ray, const FColliderFilter &filter, bool any, FSnapshotHit &hit,
+    std::vector<int> &stack) const
+{
+    if (root < 0)
+    {
+        return false;
+    }
+
+    // 找到碰撞点后，用缩短的射线裁剪结点。碰撞体仍然使用原始射线检测，保证结果与FPhysics2D::linecast相同
+    FRay clipRay(ray.start, ray.normal, hit.distance);
+    FRaycastHit tempHit;
+    bool collide = false;
+
+    stack.clear();
+    stack.push_back(root);
+    while (!stack.empty())
+    {
+        const FSnapshotNode &node = nodes_[stack.back()];
+        stack.pop_back();
+
+        if (node.bb.getDistance(clipRay.start, clipRay.end) == FMath::FloatMax)
+        {
+            continue;
+        }
+
+        if (node.shape < 0)
+        {
+            // 离射线起点更近的子结点后入栈，先检测
+            FFloat d1 = nodes_[node.left].bb.getDistance(clipRay.start, clipRay.end);
+            FFloat d2 = nodes_[node.right].bb.getDistance(clipRay.start, clipRay.end);
+            if (d1 < d2)
+            {
+                stack.push_back(node.right);
+                stack.push_back(node.left);
+            }
+            else
+            {
+                stack.push_back(node.left);
+                stack.push_back(node.right);
+            }
+            continue;
+        }
+
+        const FSnapshotShape &shape = shapes_[node.shape];
+        if (shape.isTrigger || !filter.canCollide(shape.filter) || !rayCast(shape, ray, tempHit))
+        {
+            continue;
+        }
+
+        if (tempHit.distance < hit.distance || hit.shape == nullptr)
+        {
+            hit.shape = &shape;
+            hit.point = tempHit.point;
+            hit.normal = tempHit.normal;
+            hit.distance = tempHit.distance;
+            clipRay.set(ray.start, ray.normal, hit.distance);
+        }
+        collide = true;
+
+        if (any)
+        {
+            break;
+        }
+    }
+    return collide;
+}
+
+bool FQuerySnapshot::linecast(const FVector3 &start, const FVector3 &end, const FColliderFilter &filter, FSnapshotHit &hit,
+    FQueryContext &context) const
+{
+    FRay ray(start.toXZ(), end.toXZ());
+    hit.shape = nullptr;
+    hit.distance = ray.distance;
+
+    bool collide = queryByRay(dynamicRoot_, ray, filter, false, hit, context.getIndexStack());
+    collide = queryByRay(staticRoot_, ray, filter, false, hit, context.getIndexStack()) || collide;
+    return collide;
+}
+
+bool FQuerySnapshot::occluded(const FVector3 &start, const FVector3 &end, const FColliderFilter &filter, FQueryContext &context) const
+{
+    FRay ray(start.toXZ(), end.toXZ());
+    if (ray.distance <= 0)
+    {
+        return false;
+    }
+
+    FSnapshotHit hit;
+    hit.distance = ray.distance;
+    // 静态碰撞体通常是墙体，更容易阻挡视线，先查询
+    return queryByRay(staticRoot_, ray, filter, true, hit, context.getIndexStack()) ||
+        queryByRay(dynamicRoot_, ray, filter, true, hit, context.getIndexStack());
+}
+
+int FQuerySnapshot::queryBounds(const FBB &bounds, const FColliderFilter &filter, std::vector<const FSnapshotShape*> &results,
+    FQueryContext &context) const
+{
+    size_t begin = results.size();
+
+    std::vector<int> &stack = context.getIndexStack();
+    int roots[] = { dynamicRoot_, staticRoot_ };
+    for (int root : roots)
+    {
+        if (root < 0)
+        {
+            continue;
+        }
+
+        stack.clear();
+        stack.push_back(root);
+        while (!stack.empty())
+        {
+            const FSnapshotNode &node = nodes_[stack.back()];
+            stack.pop_back();
+
+            if (!node.bb.intersect(bounds))
+            {
+                continue;
+            }
+
+            if (node.shape < 0)
+            {
+                stack.push_back(node.left);
+                stack.push_back(node.right);
+                continue;
+            }
+
+            const FSnapshotShape &shape = shapes_[node.shape];
+            if (!shape.isTrigger && filter.canCollide(shape.filter) && shape.bounds.intersect(bounds))
+            {
+                results.push_back(&shape);
+            }
+        }
+    }
+    return int(results.size() - begin);
+}
+
+size_t FQuerySnapshot::getMemorySize() const
+{
+    return sizeof(*this) +
+        nodes_.capacity() * sizeof(FSnapshotNode) +
+        shapes_.capacity() * sizeof(FSnapshotShape) +
+        vertices_.capacity() * sizeof(FVector2) +
+        pending_.capacity() * sizeof(std::pair<FBVHNode*, int>);
+}
+
+NS_FXP_END
@@ -0,0 +1,139 @@
+﻿//////////////////////////////////////////////////////////////////////
+/// Desc  FQuerySnapshot
+/// Time  2026/10/18
+/// Author youlanhai
+//////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "math/FVector2.hpp"
+#include "math/FVector3.hpp"
+#include "FBB.hpp"
+#include "FPhysicsDef.hpp"
+
+#include <utility>
+#include <vector>
+
+NS_FXP_BEGIN
+
+class FBVHTree;
+class FBVHNode;
+class FCollider;
+class FQueryContext;
+class FRay;
+
+/** 快照中的BVH结点。shape不小于0表示叶结点 */
+class FSnapshotNode
+{
+public:
+    FBB         bb;
+    int         left = -1;
+    int         right = -1;
+    int         shape = -1;
+};
+
+/** 快照中的碰撞体。只保存查询需要的世界坐标几何数据，不引用碰撞体对象 */
+class FSnapshotShape
+{
+public:
+    uint32_t        colliderID = 0;
+    uint32_t        bodyID = 0;
+    FColliderType   type = FT_CIRCLE;
+    bool            isTrigger = false;
+    FColliderFilter filter;
+    FBB             bounds;
+    /** 圆形的圆心和半径 */
+    FVector2        center;
+    FFloat          radius;
+    /** 线段和多边形的顶点，在FQuerySnapshot的顶点数组中的范围 */
+    uint32_t        vertexBegin = 0;
+    uint32_t        vertexCount = 0;
+};
+
+/** 快照的射线查询结果。碰撞体对象可能已经被删除，通过shape中的id引用 */
+class FSnapshotHit
+{
+public:
+    /** 指向快照中的数据，持有快照期间有效 */
+    const FSnapshotShape* shape = nullptr;
+    FVector3        point;
+    FVector3        normal;
+    FFloat          distance = FFloat(0);
+};
+
+/** 不可修改的查询快照。
+ *  由FPhysics2D在tick结束时生成，把两棵BVH树压缩成连续的数组，并复制碰撞体的几何数据和过滤参数。
+ *  快照生成后不再修改，其它线程可以在下一次tick进行的同时，用自己的FQueryContext无锁查询。
+ *  查询结果与FPhysics2D的同名查询相同，但只反映生成快照时的状态。
+ */
+class FXP_API FQuerySnapshot
+{
+    DISABLE_COPY_AND_ASSIGN(FQuerySnapshot);
+public:
+    FQuerySnapshot();
+    ~FQuerySnapshot();
+
+    /** @private 从BVH树生成快照。会复用已分配的内存。
+     *  静态树的版本号和staticStamp都与上次生成时相同时，保留上次复制的静态部分，只复制动态树
+     *  @param staticStamp 静态碰撞体的变化计数，由FPhysics2D维护
+     */
+    void build(FBVHTree *dynamicTree, FBVHTree *staticTree, uint32_t staticStamp, int tickStamp);
+
+    /** 生成快照时的tick索引 */
+    int getTickStamp() const { return tickStamp_; }
+
+    size_t getNumShapes() const { return shapes_.size(); }
+    const FSnapshotShape& getShape(size_t i) const { return shapes_[i]; }
+    /** 线段和多边形的世界坐标顶点 */
+    const FVector2* getVertices(const FSnapshotShape &shape) const { return vertices_.data() + shape.vertexBegin; }
+
+    /** 查询与点相交的碰撞体 */
+    const FSnapshotShape* pointCast(const FVector3 &point, FFloat radius, FQueryContext &context) const;
+
+    /** 射线拾取。查询与射线相交且距离最近的碰撞体，不包括触发器 */
+    bool linecast(const FVector3 &start, const FVector3 &end, const FColliderFilter &filter, FSnapshotHit &hit,
+        FQueryContext &context) const;
+
+    /** 视线检测。线段被任意碰撞体阻挡就返回true */
+    bool occluded(const FVector3 &start, const FVector3 &end, const FColliderFilter &filter, FQueryContext &context) const;
+
+    /** 查询包围盒与bounds相交的碰撞体，不包括触发器。结果追加到results的末尾
+     *  @return 追加的数量
+     */
+    int queryBounds(const FBB &bounds, const FColliderFilter &filter, std::vector<const FSnapshotShape*> &results,
+        FQueryContext &context) const;
+
+    size_t getMemorySize() const;
+
+private:
+    /** 复制一棵树，返回根结点的索引。空树返回-1 */
+    int buildTree(FBVHNode *root);
+
+    void addShape(FCollider *collider);
+
+    bool rayCast(const FSnapshotShape &shape, const FRay &ray, FRaycastHit &hit) const;
+
+    /** 查询射线最先撞到的碰撞体。any为true时，撞到任意碰撞体就返回 */
+    bool queryByRay(int root, const FRay &ray, const FColliderFilter &filter, bool any, FSnapshotHit &hit,
+        std::vector<int> &stack) const;
+
+private:
+    std::vector<FSnapshotNode>  nodes_;
+    std::vector<FSnapshotShape> shapes_;
+    std::vector<FVector2>       vertices_;
+    /** 生成时的遍历栈，复用内存 */
+    std::vector<std::pair<FBVHNode*, int>> pending_;
+    int                         dynamicRoot_ = -1;
+    int                         staticRoot_ = -1;
+    int                         tickStamp_ = 0;
+
+    /** 静态部分位于数组的前面，以下是它的大小和生成时的版本 */
+    size_t                      staticNodeCount_ = 0;
+    size_t                      staticShapeCount_ = 0;
+    size_t                      staticVertexCount_ = 0;
+    uint32_t                    staticVersion_ = 0;
+    uint32_t                    staticStamp_ = 0;
+    bool                        staticCached_ = false;
+};
+
+NS_FXP_END
@@ -116,6 +116,7 @@ void FRigidbody::setBodyPosition(const FVector3 &v)
     }
     
     position = v;
+    prevPosition_ = v; // 直接设置的位置不参与插值
     markTransformDirty();
 }
 
@@ -127,9 +128,47 @@ void FRigidbody::setBodyAngle(FFloat v)
     }
     
     angle = v;
+    prevAngle_ = v;
     markTransformDirty();
 }
 
+void FRigidbody::savePrevTransform()
+{
+    prevPosition_ = position;
+    prevAngle_ = angle;
+    prevStamp_ = physics_ ? physics_->getTickStamp() : -1;
+}
+
+const FVector3& FRigidbody::getPrevBodyPosition() const
+{
+    if (physics_ == nullptr || prevStamp_ != physics_->getTickStamp())
+    {
+        return position;
+    }
+    return prevPosition_;
+}
+
+FFloat FRigidbody::getPrevBodyAngle() const
+{
+    if (physics_ == nullptr || prevStamp_ != physics_->getTickStamp())
+    {
+        return angle;
+    }
+    return prevAngle_;
+}
+
+FVector3 FRigidbody::getInterpolatedPosition(FFloat alpha) const
+{
+    const FVector3 &prev = getPrevBodyPosition();
+    return prev + (position - prev) * alpha;
+}
+
+FFloat FRigidbody::getInterpolatedAngle(FFloat alpha) const
+{
+    FFloat prev = getPrevBodyAngle();
+    return prev + (angle - prev) * alpha;
+}
+
 void FRigidbody::setBodyScale(FFloat v)
 {
     if (scale == v)
@@ -171,26 +210,48 @@ void FRigidbody::postUpdate(FFloat dt)
         position += (velocity + pulseVelocity) * dt;
         angle += (angleVelocity + pulseAngleVelocity) * dt;
 
-        transformDirty_ = true;
+        updateIdleState(dt);
+    }
+
+    if (transformDirty_)
+    {
+        updateTransform();
+    }
+}
+
+void FRigidbody::updateSubstep(FFloat dt)
+{
+    if (!isDynamic())
+    {
+        return;
+    }
 
-        pulseVelocity = FVector3::Zero;
-        pulseAngleVelocity = FFloat(0);
+    velocity += (force + physics_->getGravity()) * invMass * dt;
+    angleVelocity += torque * invInertia * dt;
+}
 
-        FFloat sleepThreshold = physics_->getIdleSpeedThreshold();
-        if (velocity.lengthSq() <= sleepThreshold * sleepThreshold &&
-            angleVelocity <= sleepThreshold * 10)
-        {
-            idleTime += dt;
-            if (idleTime > physics_->getSleepTimeThreshold())
-            {
-                velocity = FVector3::Zero;
-                angleVelocity = 0;
-            }
-        }
-        else
-        {
-            idleTime = FFloat(0);
-        }
+void FRigidbody::integrateSubstep()
+{
+    if (!isDynamic())
+    {
+        return;
+    }
+
+    substepVelocity_ += velocity;
+    substepAngleVelocity_ += angleVelocity;
+}
+
+void FRigidbody::postSubsteps(FFloat dt, FFloat stepTime)
+{
+    if (isDynamic())
+    {
+        position += substepVelocity_ * stepTime + pulseVelocity * dt;
+        angle += substepAngleVelocity_ * stepTime + pulseAngleVelocity * dt;
+
+        substepVelocity_ = FVector3::Zero;
+        substepAngleVelocity_ = FFloat(0);
+
+        updateIdleState(dt);
     }
 
     if (transformDirty_)
@@ -199,11 +260,60 @@ void FRigidbody::postUpdate(FFloat dt)
     }
 }
 
+/** 去掉v在normal方向上的正分量 */
+static void clipVelocity(FVector3 &v, const FVector3 &normal)
+{
+    FFloat vn = v.dot(normal);
+    if (vn > 0)
+    {
+        v -= normal * vn;
+    }
+}
+
+void FRigidbody::clipMotion(const FVector3 &normal, FFloat distance, FFloat dt)
+{
+    clipVelocity(velocity, normal);
+    clipVelocity(pulseVelocity, normal);
+    clipVelocity(substepVelocity_, normal);
+
+    // 本帧剩余的位移通过脉冲速度补上，下一帧就不会再朝碰撞体运动
+    pulseVelocity += normal * (distance / dt);
+}
+
+void FRigidbody::updateIdleState(FFloat dt)
+{
+    transformDirty_ = true;
+
+    pulseVelocity = FVector3::Zero;
+    pulseAngleVelocity = FFloat(0);
+
+    FFloat sleepThreshold = physics_->getIdleSpeedThreshold();
+    if (velocity.lengthSq() <= sleepThreshold * sleepThreshold &&
+        angleVelocity <= sleepThreshold * 10)
+    {
+        idleTime += dt;
+        if (idleTime > physics_->getSleepTimeThreshold())
+        {
+            velocity = FVector3::Zero;
+            angleVelocity = 0;
+        }
+    }
+    else
+    {
+        idleTime = FFloat(0);
+    }
+}
+
 void FRigidbody::updateTransform()
 {
     transformDirty_ = false;
     matrix.setTransform(FVector2(position.x, position.z), angle, FVector2(scale, scale));
 
+    if (bInPhysics_ && isStatic())
+    {
+        physics_->onStaticShapeChange();
+    }
+
     for (auto collider : colliders_)
     {
         FBB bb = collider->getBounds();
@@ -216,6 +326,88 @@ void FRigidbody::updateTransform()
     }
 }
 
+void FRigidbody::saveState(FRigidbodyState &state) const
+{
+    state.mass = mass;
+    state.invMass = invMass;
+    state.inertia = inertia;
+    state.invInertia = invInertia;
+
+    state.position = position;
+    state.angle = angle;
+    state.scale = scale;
+
+    state.velocity = velocity;
+    state.force = force;
+    state.forceImpulse = forceImpulse;
+    state.angleVelocity = angleVelocity;
+    state.torque = torque;
+    state.torqueImpulse = torqueImpulse;
+    state.pulseVelocity = pulseVelocity;
+    state.pulseAngleVelocity = pulseAngleVelocity;
+    state.idleTime = idleTime;
+
+    state.substepVelocity = substepVelocity_;
+    state.substepAngleVelocity = substepAngleVelocity_;
+
+    state.prevPosition = prevPosition_;
+    state.prevAngle = prevAngle_;
+    state.prevStamp = prevStamp_;
+
+    state.collisionStamp = collisionStamp_;
+    state.id = id_;
+    state.type = type_;
+    state.isActive = isActive_;
+    state.transformDirty = transformDirty_;
+    state.continuousCollision = continuousCollision_;
+}
+
+void FRigidbody::restoreState(const FRigidbodyState &state)
+{
+    // 当前的变换是最新的，并且位置没有变化时，碰撞体不需要重新计算
+    bool moved = transformDirty_ || position != state.position || angle != state.angle || scale != state.scale;
+
+    mass = state.mass;
+    invMass = state.invMass;
+    inertia = state.inertia;
+    invInertia = state.invInertia;
+
+    position = state.position;
+    angle = state.angle;
+    scale = state.scale;
+
+    velocity = state.velocity;
+    force = state.force;
+    forceImpulse = state.forceImpulse;
+    angleVelocity = state.angleVelocity;
+    torque = state.torque;
+    torqueImpulse = state.torqueImpulse;
+    pulseVelocity = state.pulseVelocity;
+    pulseAngleVelocity = state.pulseAngleVelocity;
+    idleTime = state.idleTime;
+
+    substepVelocity_ = state.substepVelocity;
+    substepAngleVelocity_ = state.substepAngleVelocity;
+
+    prevPosition_ = state.prevPosition;
+    prevAngle_ = state.prevAngle;
+    prevStamp_ = state.prevStamp;
+
+    collisionStamp_ = state.collisionStamp;
+    isActive_ = state.isActive;
+    continuousCollision_ = state.continuousCollision;
+
+    if (moved)
+    {
+        matrix.setTransform(FVector2(position.x, position.z), angle, FVector2(scale, scale));
+        for (auto &collider : colliders_)
+        {
+            collider->updateTransform();
+        }
+    }
+    transformDirty_ = state.transformDirty;
+}
+
 bool FRigidbody::canSleep()
 {
     if (isStatic() || !isActive_)
@@ -263,6 +455,11 @@ void FRigidbody::setActive(bool active)
     if (active)
     {
         idleTime = FFloat(0);
+        // tick中途被唤醒的刚体，也要记录唤醒前的位置
+        if (prevStamp_ != physics_->getTickStamp())
+        {
+            savePrevTransform();
+        }
         physics_->addActiveRigidbody(this);
     }
 }
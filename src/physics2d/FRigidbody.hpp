@@ -18,6 +18,44 @@ NS_FXP_BEGIN
 class FPhysics2D;
 class FCollider;
 
+/** 刚体的模拟状态，用于回滚。只包含数值，不包含碰撞体和物理世界的引用 */
+struct FRigidbodyState
+{
+    FFloat          mass;
+    FFloat          invMass;
+    FFloat          inertia;
+    FFloat          invInertia;
+
+    FVector3        position;
+    FFloat          angle;
+    FFloat          scale;
+
+    FVector3        velocity;
+    FVector3        force;
+    FVector3        forceImpulse;
+    FFloat          angleVelocity;
+    FFloat          torque;
+    FFloat          torqueImpulse;
+    FVector3        pulseVelocity;
+    FFloat          pulseAngleVelocity;
+    FFloat          idleTime;
+
+    FVector3        substepVelocity;
+    FFloat          substepAngleVelocity;
+
+    FVector3        prevPosition;
+    FFloat          prevAngle;
+    int             prevStamp;
+
+    int             collisionStamp;
+    uint32_t        id;
+    /** 只用于校验。类型不同时碰撞体所在的BVH树不同，不能恢复 */
+    FRigidbodyType  type;
+    bool            isActive;
+    bool            transformDirty;
+    bool            continuousCollision;
+};
+
 class FXP_API FRigidbody : public IRefCount
 {
 public:
@@ -71,6 +109,10 @@ public:
     /// 是否是动力学刚体
     bool isKinematic() const { return getType() == FRigidbodyType::Kinematic; }
 
+    /** 开启连续碰撞检测。移动速度很快的动态刚体，每帧会沿位移方向查询与静态碰撞体的撞击时间，避免穿过较薄的墙体 */
+    void setContinuousCollision(bool enable) { continuousCollision_ = enable; }
+    bool isContinuousCollision() const { return continuousCollision_; }
+
     bool canSleep();
 
     void setActive(bool active);
@@ -110,6 +152,15 @@ public:
     void setBodyVelocity(const FVector3 &v){ velocity = v; setActive(true); }
     const FVector3& getBodyVelocity() const { return velocity; }
     
+    /** 上一次tick开始时的位置。本次tick中刚体没有运动时，与当前位置相同 */
+    const FVector3& getPrevBodyPosition() const;
+    /** 上一次tick开始时的角度 */
+    FFloat getPrevBodyAngle() const;
+
+    /** 在上一次和当前的tick结果之间插值，alpha取FPhysics2D::getInterpolationAlpha */
+    FVector3 getInterpolatedPosition(FFloat alpha) const;
+    FFloat getInterpolatedAngle(FFloat alpha) const;
+
     void setAngleVelociy(FFloat v) { angleVelocity = v; setActive(true); }
     FFloat getAngleVelocity() const { return angleVelocity; }
  
@@ -126,6 +177,8 @@ public:
 private:
     friend class FPhysics2D;
     friend class FCollider;
+    friend class FIslandBuilder;
+    friend class FContactSolver;
 
     /// @private 添加到物理世界后回调
     void onAddToPhysicsWorld();
@@ -147,10 +200,33 @@ private:
     /** 更新坐标 */
     void update(FFloat deltaTime);
     void postUpdate(FFloat deltaTime);
+
+    /** 子步模式。第一个子步使用update，之后的子步只计算作用力 */
+    void updateSubstep(FFloat deltaTime);
+    /** 子步模式。累积子步的速度，在postSubsteps中一次性应用到位置上 */
+    void integrateSubstep();
+    /** 子步模式下代替postUpdate
+     *  @param stepTime 子步的时长
+     */
+    void postSubsteps(FFloat deltaTime, FFloat stepTime);
+
+    /** 记录tick开始时的位置和角度 */
+    void savePrevTransform();
+
+    /** 更新休眠计时，并标记变换需要更新 */
+    void updateIdleState(FFloat deltaTime);
+
+    /** 连续碰撞检测。去掉朝向normal方向的速度分量，本帧沿normal只前进distance，刚好停在撞击点 */
+    void clipMotion(const FVector3 &normal, FFloat distance, FFloat dt);
     
     void setCollisionStamp(int index) { collisionStamp_ = index; }
     int getCollisionStamp() const { return collisionStamp_; }
 
+    /** 保存模拟状态 */
+    void saveState(FRigidbodyState &state) const;
+    /** 恢复模拟状态。位置发生变化时重新计算碰撞体的变换，但不会通知物理世界更新BVH树，由调用者负责 */
+    void restoreState(const FRigidbodyState &state);
+
 private:
     uint32_t        id_ = 0;
     
@@ -186,18 +262,38 @@ private:
 
     FFloat          idleTime = FFloat(0);
 
+    /** 子步模式下，本帧各子步的速度之和。乘以子步时长就是位移。
+     *  子步时长很小，每个子步单独计算位移会损失定点数的精度
+     */
+    FVector3        substepVelocity_;
+    /** 子步模式下，本帧各子步的角速度之和 */
+    FFloat          substepAngleVelocity_;
+
+    /** 上一次tick开始时的位置和角度，用于插值 */
+    FVector3        prevPosition_;
+    FFloat          prevAngle_;
+    /** 记录prevPosition_时的tick索引。与当前tick不同说明本次tick没有运动 */
+    int             prevStamp_ = -1;
+
     FMatrix2D       matrix;
 
     FPhysics2D*     physics_ = nullptr;
     bool            isActive_ = false;
     bool            bInPhysics_ = false;
     bool            transformDirty_ = false;
+    bool            continuousCollision_ = false;
     
     FRigidbodyType  type_ = FRigidbodyType::Dynamic;
 
     std::vector<SmartPtr<FCollider>>   colliders_;
     /** 用来标记发生碰撞的帧索引 */
     int             collisionStamp_ = 0;
+    /** 在岛屿构建器中的索引。-1表示不在构建器中 */
+    int             islandIndex_ = -1;
+    /** 着色求解时，已被本刚体的碰撞对占用的颜色 */
+    uint64_t        colorMask_ = 0;
+    /** 在接触求解器中的索引。-1表示不在求解器中 */
+    int             solverIndex_ = -1;
 };
 
 inline const FMatrix2D& FRigidbody::getMatrix() const
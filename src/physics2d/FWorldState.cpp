@@ -0,0 +1,33 @@
+﻿//////////////////////////////////////////////////////////////////////
+/// Desc  FWorldState
+/// Time  2026/10/18
+/// Author youlanhai
+//////////////////////////////////////////////////////////////////////
+
+#include "FWorldState.hpp"
+
+NS_FXP_BEGIN
+
+FWorldState::FWorldState()
+{
+}
+
+FWorldState::~FWorldState()
+{
+}
+
+size_t FWorldState::getMemorySize() const
+{
+    return sizeof(*this) +
+        bodies_.capacity() * sizeof(FRigidbody*) +
+        bodyStates_.capacity() * sizeof(FRigidbodyState) +
+        colliders_.capacity() * sizeof(FColliderState) +
+        activeBodies_.capacity() * sizeof(FRigidbody*) +
+        pairs_.capacity() * sizeof(FColliderPairState) +
+        dynamicTree_.nodes.capacity() * sizeof(FBVHNodeState) +
+        staticTree_.nodes.capacity() * sizeof(FBVHNodeState) +
+        projectiles_.projectiles.capacity() * sizeof(FProjectile) +
+        projectiles_.hits.capacity() * sizeof(FProjectileHit);
+}
+
+NS_FXP_END
@@ -0,0 +1,76 @@
+﻿//////////////////////////////////////////////////////////////////////
+/// Desc  FWorldState
+/// Time  2026/10/18
+/// Author youlanhai
+//////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "FPhysicsDef.hpp"
+#include "FRigidbody.hpp"
+#include "FBVHTree.hpp"
+#include "FProjectileSystem.hpp"
+
+#include <vector>
+
+NS_FXP_BEGIN
+
+/** 碰撞体的状态。变换后的顶点由刚体的位置重新计算，只保存包围盒 */
+struct FColliderState
+{
+    FCollider*      collider;
+    FBB             bounds;
+    FColliderFilter filter;
+    bool            isTrigger;
+};
+
+/** 碰撞对的状态。碰撞体不增加引用计数 */
+struct FColliderPairState
+{
+    uint64_t        id;
+    FCollider*      a;
+    FCollider*      b;
+    int             stamp;
+    bool            isTrigger;
+    FColliderPair::FCollisionState state;
+    FCollisionInfo  collisionInfo;
+};
+
+/** 物理世界的模拟状态，用于帧同步回滚。由FPhysics2D::saveState和restoreState读写。
+ *  所有数据都保存在连续的数组中，同一个对象反复保存时复用数组的内存；BVH树没有变化时不会重复拷贝。
+ *  不持有刚体和碰撞体的引用。保存和恢复之间不能增删刚体、碰撞体，也不能修改刚体的类型，否则恢复会失败。
+ */
+class FXP_API FWorldState
+{
+public:
+    FWorldState();
+    ~FWorldState();
+
+    /** 保存时的tick索引 */
+    int getTickStamp() const { return tickStamp_; }
+
+    size_t getMemorySize() const;
+
+private:
+    friend class FPhysics2D;
+
+    /** 与FPhysics2D中的刚体一一对应 */
+    std::vector<FRigidbody*>        bodies_;
+    std::vector<FRigidbodyState>    bodyStates_;
+    /** 按刚体的顺序排列的碰撞体 */
+    std::vector<FColliderState>     colliders_;
+    /** 活跃的刚体，按id排序 */
+    std::vector<FRigidbody*>        activeBodies_;
+    /** 按id排序 */
+    std::vector<FColliderPairState> pairs_;
+
+    FBVHTreeState       dynamicTree_;
+    FBVHTreeState       staticTree_;
+    FProjectileState    projectiles_;
+
+    int                 tickStamp_ = 0;
+    uint32_t            idCounter_ = 0;
+    FFloat              accumulatedTime_;
+};
+
+NS_FXP_END
@@ -427,6 +427,7 @@ public:
 
 NS_FXP_BEGIN
 FXP_API void testFMath();
+FXP_API void testFPhysics();
 NS_FXP_END
 
 int main(int argc, char **argv)
@@ -434,6 +435,7 @@ int main(int argc, char **argv)
     LOG_INFO(USAGE);
 
     testFMath();
+    testFPhysics();
     reportTest();
 
     MainApp app;